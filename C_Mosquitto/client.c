@@ -4,13 +4,28 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 
 #define BROKER "192.168.100.10"
 #define PORT 1883
 #define TOPIC "test"
 
+/* Histograma de latencia: cubetas de 10 us hasta 1 s, mas overflow.
+   Preallocated una vez; on_message solo incrementa un contador. */
+#define LAT_BUCKET_US 10
+#define LAT_BUCKETS 100000
+
 volatile int running = 1;
 
+static unsigned long *lat_hist = NULL;
+static unsigned long lat_count = 0;
+static unsigned long lat_overflow = 0;
+static double lat_max_us = 0.0;
+
+/* Antes de este instante las muestras son warm-up y se descartan.
+   Cero significa sin warm-up (modo standalone). */
+static double lat_stats_start = 0.0;
+
 /* ================================
    Tiempo actual
 ================================ */
@@ -31,6 +46,76 @@ void on_message(struct mosquitto *mosq, void *userdata,
     (void)userdata;
 }
 
+/* ================================
+   Callback subscriber (latencia)
+
+   El payload empieza con el timestamp del publisher; la
+   resta da el one-way delay, que cae en una cubeta.
+================================ */
+void on_message_latency(struct mosquitto *mosq, void *userdata,
+                        const struct mosquitto_message *msg)
+{
+    (void)mosq;
+    (void)userdata;
+
+    if (msg->payloadlen <= 0)
+        return;
+
+    double sent_at = atof((const char *)msg->payload);
+    if (sent_at <= 0.0)
+        return;
+
+    double now = current_time();
+    if (now < lat_stats_start)
+        return; /* transitorio de conexion: fuera de las estadisticas */
+
+    double delay_us = (now - sent_at) * 1000000.0;
+    if (delay_us < 0.0)
+        delay_us = 0.0;
+
+    long bucket = (long)(delay_us / LAT_BUCKET_US);
+    if (bucket >= LAT_BUCKETS)
+        lat_overflow++;
+    else
+        lat_hist[bucket]++;
+
+    lat_count++;
+    if (delay_us > lat_max_us)
+        lat_max_us = delay_us;
+}
+
+/* ================================
+   Percentil desde el histograma
+================================ */
+double histogram_percentile(double percentile)
+{
+    unsigned long target =
+        (unsigned long)(lat_count * percentile / 100.0);
+    unsigned long seen = 0;
+
+    for (long i = 0; i < LAT_BUCKETS; i++)
+    {
+        seen += lat_hist[i];
+        if (seen >= target)
+            return (i + 1) * (double)LAT_BUCKET_US;
+    }
+    return lat_max_us;
+}
+
+/* ================================
+   Barrera de arranque
+
+   Cada hijo bloquea leyendo el pipe; el padre cierra el
+   extremo de escritura cuando todos estan conectados y el
+   read retorna 0 en todos a la vez.
+================================ */
+void wait_for_barrier(int barrier_fd)
+{
+    char byte;
+    if (barrier_fd >= 0)
+        read(barrier_fd, &byte, 1);
+}
+
 /* ================================
    Subscriber
 ================================ */
@@ -55,13 +140,97 @@ void run_subscriber(int id)
     mosquitto_lib_cleanup();
 }
 
+/* ================================
+   Subscriber en modo latencia
+
+   Corre exec_time segundos y al salir imprime
+   p50/p95/p99/max en CSV, igual que los de throughput.
+================================ */
+void run_latency_subscriber_ex(int id, int execution_time,
+                               int warmup, int barrier_fd, int results_fd)
+{
+    char client_id[50];
+    sprintf(client_id, "lat_%d", id);
+
+    lat_hist = calloc(LAT_BUCKETS, sizeof(unsigned long));
+    if (!lat_hist)
+    {
+        printf("No memory for latency histogram\n");
+        return;
+    }
+
+    mosquitto_lib_init();
+
+    struct mosquitto *mosq =
+        mosquitto_new(client_id, true, NULL);
+
+    mosquitto_message_callback_set(mosq, on_message_latency);
+
+    mosquitto_connect(mosq, BROKER, PORT, 60);
+    mosquitto_subscribe(mosq, NULL, TOPIC, 1);
+
+    /* Todos los clientes arrancan juntos; el warm-up cubre el
+       transitorio de conexion y queda fuera del histograma */
+    wait_for_barrier(barrier_fd);
+
+    double program_start = current_time();
+    lat_stats_start = program_start + warmup;
+    while ((current_time() - program_start) < execution_time + warmup)
+    {
+        mosquitto_loop(mosq, 100, 1);
+    }
+
+    if (results_fd >= 0)
+    {
+        /* Una linea por hijo hacia el orquestador (< PIPE_BUF) */
+        char line[256];
+        int len = snprintf(line, sizeof(line),
+                           "L,%s,%lu,%.0f,%.0f,%.0f,%.0f\n",
+                           client_id,
+                           lat_count,
+                           histogram_percentile(50.0),
+                           histogram_percentile(95.0),
+                           histogram_percentile(99.0),
+                           lat_max_us);
+        write(results_fd, line, len);
+    }
+    else
+    {
+        printf("client_id,messages,overflow,p50_us,p95_us,p99_us,max_us\n");
+        printf("%s,%lu,%lu,%.0f,%.0f,%.0f,%.0f\n",
+               client_id,
+               lat_count,
+               lat_overflow,
+               histogram_percentile(50.0),
+               histogram_percentile(95.0),
+               histogram_percentile(99.0),
+               lat_max_us);
+    }
+
+    free(lat_hist);
+    lat_hist = NULL;
+
+    mosquitto_disconnect(mosq);
+    mosquitto_destroy(mosq);
+    mosquitto_lib_cleanup();
+}
+
+void run_latency_subscriber(int id, int execution_time)
+{
+    run_latency_subscriber_ex(id, execution_time, 0, -1, -1);
+}
+
 /* ================================
    Publisher CONTROLADO
+
+   Cada payload empieza con el timestamp de envio, para que
+   el subscriber en modo latencia pueda medir el delay.
 ================================ */
-void run_publisher(int id,
-                   int payload_size,
-                   int execution_time,
-                   double publish_frequency)
+void run_publisher_ex(int id,
+                      int payload_size,
+                      int execution_time,
+                      double publish_frequency,
+                      int warmup, int barrier_fd, int results_fd)
 {
     char client_id[50];
     sprintf(client_id, "pub_%d", id);
@@ -78,10 +247,15 @@ void run_publisher(int id,
 
     int message_count = 0;
 
+    /* Todos los clientes arrancan juntos; se publica tambien
+       durante el warm-up pero esos mensajes no se cuentan */
+    wait_for_barrier(barrier_fd);
+
     double program_start = current_time();
+    double stats_start = program_start + warmup;
     double next_publish = program_start;
 
-    while ((current_time() - program_start) < execution_time)
+    while ((current_time() - program_start) < execution_time + warmup)
     {
         double now = current_time();
 
@@ -90,6 +264,14 @@ void run_publisher(int id,
 
         if (now >= next_publish)
         {
+            /* Timestamp al inicio del payload; el resto queda 'A' */
+            if (payload_size >= 24)
+            {
+                int written = snprintf(payload, 24, "%.6f", now);
+                if (written > 0 && written < 24)
+                    payload[written] = 'A'; /* sin NUL en el payload */
+            }
+
             mosquitto_publish(
                 mosq,
                 NULL,
@@ -99,15 +281,26 @@ void run_publisher(int id,
                 1,
                 0);
 
-            message_count++;
+            if (now >= stats_start)
+                message_count++;
             next_publish += publish_frequency;
         }
 
         usleep(1000);
     }
 
-    printf("Publisher %d sent %d messages\n",
-           id, message_count);
+    if (results_fd >= 0)
+    {
+        char line[128];
+        int len = snprintf(line, sizeof(line),
+                           "P,%s,%d\n", client_id, message_count);
+        write(results_fd, line, len);
+    }
+    else
+    {
+        printf("Publisher %d sent %d messages\n",
+               id, message_count);
+    }
 
     free(payload);
 
@@ -116,6 +309,120 @@ void run_publisher(int id,
     mosquitto_lib_cleanup();
 }
 
+void run_publisher(int id,
+                   int payload_size,
+                   int execution_time,
+                   double publish_frequency)
+{
+    run_publisher_ex(id, payload_size, execution_time,
+                     publish_frequency, 0, -1, -1);
+}
+
+/* ================================
+   Orquestador multi-proceso
+
+   Un solo comando lanza M subscribers y N publishers con
+   fork(), los suelta a la vez con la barrera, descarta el
+   warm-up y agrega los resultados de todos los hijos en un
+   reporte CSV final.
+================================ */
+void run_orchestrator(int n_pubs, int n_subs,
+                      int payload_size, int execution_time,
+                      double publish_frequency, int warmup)
+{
+    int barrier_pipe[2];
+    int results_pipe[2];
+
+    if (pipe(barrier_pipe) < 0 || pipe(results_pipe) < 0)
+    {
+        printf("pipe() failed\n");
+        return;
+    }
+
+    int children = 0;
+
+    /* Subscribers primero, para que esten suscritos cuando los
+       publishers empiecen a enviar */
+    for (int i = 0; i < n_subs; i++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(barrier_pipe[1]);
+            close(results_pipe[0]);
+            run_latency_subscriber_ex(i, execution_time, warmup,
+                                      barrier_pipe[0], results_pipe[1]);
+            exit(0);
+        }
+        if (pid > 0)
+            children++;
+    }
+
+    for (int i = 0; i < n_pubs; i++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(barrier_pipe[1]);
+            close(results_pipe[0]);
+            run_publisher_ex(i, payload_size, execution_time,
+                             publish_frequency, warmup,
+                             barrier_pipe[0], results_pipe[1]);
+            exit(0);
+        }
+        if (pid > 0)
+            children++;
+    }
+
+    /* Soltar la barrera: cerrar la escritura desbloquea el read
+       de todos los hijos a la vez */
+    close(barrier_pipe[0]);
+    close(barrier_pipe[1]);
+    close(results_pipe[1]);
+
+    /* Agregado: suma de mensajes, y el peor percentil entre los
+       subscribers (el SLO se mide contra el peor caso) */
+    unsigned long total_sent = 0;
+    unsigned long total_received = 0;
+    double p50 = 0.0, p95 = 0.0, p99 = 0.0, max_us = 0.0;
+
+    FILE *results = fdopen(results_pipe[0], "r");
+    char line[256];
+    while (results && fgets(line, sizeof(line), results))
+    {
+        if (line[0] == 'P')
+        {
+            unsigned long sent = 0;
+            if (sscanf(line, "P,%*[^,],%lu", &sent) == 1)
+                total_sent += sent;
+        }
+        else if (line[0] == 'L')
+        {
+            unsigned long count = 0;
+            double s50, s95, s99, smax;
+            if (sscanf(line, "L,%*[^,],%lu,%lf,%lf,%lf,%lf",
+                       &count, &s50, &s95, &s99, &smax) == 5)
+            {
+                total_received += count;
+                if (s50 > p50) p50 = s50;
+                if (s95 > p95) p95 = s95;
+                if (s99 > p99) p99 = s99;
+                if (smax > max_us) max_us = smax;
+            }
+        }
+    }
+    if (results)
+        fclose(results);
+
+    for (int i = 0; i < children; i++)
+        wait(NULL);
+
+    printf("pubs,subs,warmup_s,exec_s,sent,received,p50_us,p95_us,p99_us,max_us\n");
+    printf("%d,%d,%d,%d,%lu,%lu,%.0f,%.0f,%.0f,%.0f\n",
+           n_pubs, n_subs, warmup, execution_time,
+           total_sent, total_received, p50, p95, p99, max_us);
+}
+
 /* ================================
    MAIN
 ================================ */
@@ -125,7 +432,9 @@ int main(int argc, char *argv[])
     {
         printf("Usage:\n");
         printf("sub id\n");
+        printf("lat id exec_time\n");
         printf("pub id payload exec_time freq\n");
+        printf("run pubs subs payload exec_time freq warmup\n");
         return 1;
     }
 
@@ -133,6 +442,16 @@ int main(int argc, char *argv[])
     {
         run_subscriber(atoi(argv[2]));
     }
+    else if (!strcmp(argv[1], "lat"))
+    {
+        if (argc != 4)
+        {
+            printf("lat id exec_time\n");
+            return 1;
+        }
+
+        run_latency_subscriber(atoi(argv[2]), atoi(argv[3]));
+    }
     else if (!strcmp(argv[1], "pub"))
     {
         if (argc != 6)
@@ -147,6 +466,22 @@ int main(int argc, char *argv[])
             atoi(argv[4]),
             atof(argv[5]));
     }
+    else if (!strcmp(argv[1], "run"))
+    {
+        if (argc != 8)
+        {
+            printf("run pubs subs payload exec_time freq warmup\n");
+            return 1;
+        }
+
+        run_orchestrator(
+            atoi(argv[2]),
+            atoi(argv[3]),
+            atoi(argv[4]),
+            atoi(argv[5]),
+            atof(argv[6]),
+            atoi(argv[7]));
+    }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,131 @@
+/// Benchmarks for the packet codecs and the subscription-lookup path.
+
+/*
+All performance numbers used to come from external clients, which measure the
+network and the client far more than the broker itself. These benchmarks
+exercise the hot in-process paths directly — PUBLISH encode/decode across the
+production payload mix (64 B telemetry, 1 KB events, 64 KB firmware chunks),
+CONNECT and SUBSCRIBE decode, and a topic lookup against a populated
+subscription table — so a codec regression shows up in `cargo bench` before
+it shows up in the load-test CSVs.
+*/
+
+use std::net::{TcpListener, TcpStream};
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+
+use mqtt_broker::outbound::Outbound;
+use mqtt_broker::packets::connect::ConnectPacket;
+use mqtt_broker::packets::publish::PublishPacket;
+use mqtt_broker::packets::subscribe::SubscribePacket;
+use mqtt_broker::subscriptions::SubscriptionTable;
+
+/// Payload sizes matching the production traffic mix.
+const PAYLOAD_SIZES: [usize; 3] = [64, 1024, 64 * 1024];
+
+fn publish_codec(c: &mut Criterion) {
+    let mut group = c.benchmark_group("publish");
+
+    // Both QoS levels matter: QoS 0 frames carry no message ID, so encode
+    // and decode must agree on the wire layout at each level
+    for qos in [0u8, 1] {
+        for size in PAYLOAD_SIZES {
+            let packet = PublishPacket::new(
+                "bench/device42/status".to_string(),
+                if qos > 0 { 7 } else { 0 },
+                qos,
+                false,
+                false,
+                vec![0xAB; size],
+            );
+            let encoded = packet.encode();
+
+            // The codec must round-trip its own output exactly
+            assert_eq!(PublishPacket::decode(&encoded).unwrap(), packet);
+
+            group.throughput(Throughput::Bytes(encoded.len() as u64));
+            group.bench_with_input(
+                BenchmarkId::new(format!("encode/qos{}", qos), size),
+                &packet,
+                |b, packet| {
+                    b.iter(|| packet.encode());
+                },
+            );
+            group.bench_with_input(
+                BenchmarkId::new(format!("decode/qos{}", qos), size),
+                &encoded,
+                |b, encoded| {
+                    b.iter(|| PublishPacket::decode(encoded).unwrap());
+                },
+            );
+        }
+    }
+
+    group.finish();
+}
+
+fn connect_decode(c: &mut Criterion) {
+    let packet = ConnectPacket::new(
+        "MQTT".to_string(),
+        5,
+        0b00000010,
+        60,
+        "bench-client".to_string(),
+        None,
+        None,
+        Some("user".to_string()),
+        Some("password".to_string()),
+    );
+    let encoded = packet.encode();
+
+    c.bench_function("connect/decode", |b| {
+        b.iter(|| ConnectPacket::decode(&encoded).unwrap());
+    });
+}
+
+fn subscribe_decode(c: &mut Criterion) {
+    let packet = SubscribePacket::new(
+        1,
+        vec!["bench/+/status".to_string(), "bench/device42/#".to_string()],
+        vec![1, 1],
+    );
+    let encoded = packet.encode();
+
+    c.bench_function("subscribe/decode", |b| {
+        b.iter(|| SubscribePacket::decode(&encoded).unwrap());
+    });
+}
+
+fn subscription_lookup(c: &mut Criterion) {
+    // The table stores Outbound handles, which need a real socket behind
+    // them; a loopback pair keeps the bench self-contained
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let addr = listener.local_addr().unwrap();
+    let client = TcpStream::connect(addr).unwrap();
+    let (server_side, _) = listener.accept().unwrap();
+    let outbound = Outbound::start(server_side);
+    drop(client);
+
+    let table = SubscriptionTable::new();
+    for device in 0..1000 {
+        table.subscribe(&format!("bench/device{}/status", device), outbound.clone());
+    }
+    table.subscribe("bench/+/status", outbound.clone());
+
+    c.bench_function("subscription/lookup", |b| {
+        b.iter(|| {
+            let mut matched = 0usize;
+            table.for_each_subscriber("bench/device500/status", |_| matched += 1);
+            matched
+        });
+    });
+}
+
+criterion_group!(
+    benches,
+    publish_codec,
+    connect_decode,
+    subscribe_decode,
+    subscription_lookup
+);
+criterion_main!(benches);
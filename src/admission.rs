@@ -0,0 +1,144 @@
+/// Accept-time admission control: per-IP token buckets and a half-open cap.
+
+/*
+Nothing used to stand between accept(2) and a full connection setup, so one
+misbehaving client reconnecting in a tight loop could burn the broker's CPU
+on CONNECT parsing and thread spawns while established sessions starved.
+
+This module gates every accepted socket before any per-connection work
+happens. Each source IP draws from a token bucket (steady refill, small
+burst capacity), so a client reconnecting at a sane rate never notices while
+a tight reconnect loop is cut off in O(1). The buckets live in a fixed-size
+table indexed by hashing the IP — no allocation on the accept path, and a
+colliding IP simply takes over the slot, which only ever makes the limiter
+more permissive, never less. A process-wide count of half-open connections
+(accepted, but no valid CONNECT yet) bounds how many sockets can sit in
+setup at once, the same shape of defense as a SYN backlog.
+
+Like the metrics module, the state is a process-wide instance so the accept
+loops and both read paths reach it without threading another Arc around.
+*/
+
+use std::net::IpAddr;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Mutex, OnceLock};
+use std::time::Instant;
+
+use crate::log_info;
+
+/// Number of token-bucket slots; a fixed power of two, never resized.
+const BUCKET_SLOTS: usize = 1024;
+
+/// Burst capacity of each bucket: connects allowed back to back from one IP.
+const BUCKET_CAPACITY: u32 = 20;
+
+/// Steady-state refill rate, in connects per second per IP.
+const REFILL_PER_SEC: u32 = 10;
+
+/// Upper bound on connections accepted but not yet past a valid CONNECT.
+const MAX_HALF_OPEN: usize = 512;
+
+/// One token bucket, owned by whichever IP hashed here most recently.
+struct Bucket {
+    ip: Option<IpAddr>,   // Slot owner; a different IP hashing here takes over
+    tokens: u32,          // Connects left before the bucket runs dry
+    last_refill: Instant, // When tokens were last topped up
+}
+
+/// Process-wide admission state shared by every accept loop and read path.
+pub struct AdmissionControl {
+    buckets: Vec<Mutex<Bucket>>,
+    half_open: AtomicUsize, // Connections accepted but not yet CONNECTed
+}
+
+impl AdmissionControl {
+    fn new() -> Self {
+        let mut buckets = Vec::with_capacity(BUCKET_SLOTS);
+        for _ in 0..BUCKET_SLOTS {
+            buckets.push(Mutex::new(Bucket {
+                ip: None,
+                tokens: BUCKET_CAPACITY,
+                last_refill: Instant::now(),
+            }));
+        }
+        AdmissionControl {
+            buckets,
+            half_open: AtomicUsize::new(0),
+        }
+    }
+
+    /// Slot index for an IP: a cheap stable hash over its raw octets.
+    fn slot_index(ip: &IpAddr) -> usize {
+        let mut hash: u64 = 0xcbf29ce484222325; // FNV-1a offset basis
+        let mut feed = |bytes: &[u8]| {
+            for &byte in bytes {
+                hash ^= byte as u64;
+                hash = hash.wrapping_mul(0x100000001b3);
+            }
+        };
+        match ip {
+            IpAddr::V4(v4) => feed(&v4.octets()),
+            IpAddr::V6(v6) => feed(&v6.octets()),
+        }
+        (hash as usize) % BUCKET_SLOTS
+    }
+
+    /// Decides whether a freshly accepted socket may proceed. Spends one
+    /// token from the source IP's bucket and claims a half-open slot; a
+    /// refusal means the caller should drop the socket immediately, before
+    /// any per-connection setup.
+    pub fn admit(&self, ip: IpAddr) -> bool {
+        // Half-open cap first: it bounds total setup work regardless of
+        // how many distinct IPs a flood comes from
+        if self.half_open.load(Ordering::Relaxed) >= MAX_HALF_OPEN {
+            log_info!("[-]Refusing connection from {}: half-open cap reached\n", ip);
+            return false;
+        }
+
+        let mut bucket = self.buckets[Self::slot_index(&ip)].lock().unwrap();
+
+        // A different IP hashing into this slot takes it over fresh; the
+        // table is approximate by design, erring on the permissive side
+        if bucket.ip != Some(ip) {
+            bucket.ip = Some(ip);
+            bucket.tokens = BUCKET_CAPACITY;
+            bucket.last_refill = Instant::now();
+        }
+
+        // Top the bucket up for the time elapsed since the last refill
+        let elapsed_ms = bucket.last_refill.elapsed().as_millis() as u64;
+        let refill = (elapsed_ms * REFILL_PER_SEC as u64 / 1000) as u32;
+        if refill > 0 {
+            bucket.tokens = (bucket.tokens + refill).min(BUCKET_CAPACITY);
+            bucket.last_refill = Instant::now();
+        }
+
+        if bucket.tokens == 0 {
+            log_info!("[-]Refusing connection from {}: reconnecting too fast\n", ip);
+            return false;
+        }
+        bucket.tokens -= 1;
+        drop(bucket);
+
+        self.half_open.fetch_add(1, Ordering::Relaxed);
+        true
+    }
+
+    /// Releases the half-open slot claimed by admit(); called once per
+    /// admitted connection, either when its CONNECT is accepted or when it
+    /// goes away without ever sending one.
+    pub fn settle(&self) {
+        self.half_open.fetch_sub(1, Ordering::Relaxed);
+    }
+
+    /// Connections currently between accept and a valid CONNECT.
+    pub fn half_open_count(&self) -> usize {
+        self.half_open.load(Ordering::Relaxed)
+    }
+}
+
+/// The process-wide admission-control instance.
+pub fn admission() -> &'static AdmissionControl {
+    static ADMISSION: OnceLock<AdmissionControl> = OnceLock::new();
+    ADMISSION.get_or_init(AdmissionControl::new)
+}
@@ -1,19 +1,28 @@
-use std::net::TcpStream;
+use std::collections::HashMap;
+use std::net::{Shutdown, TcpStream};
 use std::io::{Read, Write};
 use std::thread;
 use std::time::{Duration, Instant};
-use std::sync::{Arc, Mutex};
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Arc, Condvar, Mutex};
 use std::env;
 
+use bytes::Bytes;
+use mqtt_broker::framing::PacketFramer;
+use mqtt_broker::inflight::InflightWindow;
 use mqtt_broker::packets::{
     connect::ConnectPacket,
     connack::ConnAckPacket,
     publish::PublishPacket,
+    puback::PubAckPacket,
     subscribe::SubscribePacket,
     ping::PingReqPacket,
     disconnect::{DisconnectPacket, DisconnectReasonCode},
 };
 
+/// Address of the broker every mode connects to.
+const BROKER_ADDR: &str = "192.168.100.10:1883";
+
 fn send_connect_packet(mut stream: TcpStream, client_id: String)
 {
     let connect_packet = ConnectPacket::new(
@@ -39,11 +48,29 @@ fn receive_connack_packet(mut stream: TcpStream)
     let _ = ConnAckPacket::decode(&buffer);
 }
 
-fn send_publish_packet(mut stream: TcpStream, topic: &str, message: &str)
+fn send_publish_packet(
+    mut stream: TcpStream,
+    topic: &str,
+    message: &str,
+    inflight: &Arc<Mutex<InflightWindow>>,
+)
 {
+    // Reserve a real message ID from the inflight window so the broker's
+    // PUBACK can be matched (and the message resent if it never arrives)
+    let message_id = {
+        let mut window = inflight.lock().unwrap();
+        match window.reserve() {
+            Some(id) => id,
+            None => {
+                eprintln!("Inflight window full; dropping publish");
+                return;
+            }
+        }
+    };
+
     let publish_packet = PublishPacket::new(
         topic.to_string(),
-        1,
+        message_id,
         1,
         false,
         false,
@@ -51,6 +78,10 @@ fn send_publish_packet(mut stream: TcpStream, topic: &str, message: &str)
     );
 
     let packet = publish_packet.encode();
+    inflight
+        .lock()
+        .unwrap()
+        .track(message_id, Bytes::from(packet.clone()));
     let _ = stream.write(&packet);
 }
 
@@ -72,35 +103,301 @@ fn send_disconnect_packet(stream: &mut TcpStream)
     let _ = stream.write(&packet);
 }
 
-fn packets_listener(mut stream: TcpStream, shutdown_flag: Arc<Mutex<bool>>)
+/*
+The listener used to send a PINGREQ, block in read() and then sleep five
+seconds per iteration, so an inbound PUBLISH arriving just after a ping sat
+behind the sleep — subscriber-side latency was quantized to the ping cadence
+and measured the client, not the broker. Reading and pinging are now separate
+threads: the reader spends all its time in read() and handles each packet the
+moment it arrives, while the ping scheduler parks on the shutdown condvar
+with a timeout, so it sends keep-alives (and retransmits overdue QoS 1
+publishes) on schedule without ever delaying delivery.
+*/
+
+/// How often the scheduler sends a PINGREQ; half the 60 s keep-alive
+/// negotiated in CONNECT, so one lost ping cannot expire the session.
+const PING_INTERVAL: Duration = Duration::from_secs(30);
+
+/// Dedicated reader: blocks in read() and processes every inbound packet
+/// immediately, with no pings or sleeps on this thread.
+fn packets_listener(
+    mut stream: TcpStream,
+    shutdown: Arc<(Mutex<bool>, Condvar)>,
+    inflight: Arc<Mutex<InflightWindow>>,
+)
 {
-    let mut buffer = [0u8; 1024];
+    let mut buffer = [0u8; 4096];
+    let mut framer = PacketFramer::new();
 
     loop {
-        let ping = PingReqPacket.encode();
-        let _ = stream.write(&ping);
-
         match stream.read(&mut buffer) {
             Ok(size) if size > 0 => {
-                let packet_type = buffer[0] >> 4;
-
-                if packet_type == 3 {
-                    if let Ok(packet) =
-                        PublishPacket::decode(&buffer[..size])
-                    {
-                        let _ =
-                            String::from_utf8(packet.payload).unwrap_or_default();
+                // One read may carry several packets, or part of one
+                framer.extend(&buffer[..size]);
+                while let Ok(Some(frame)) = framer.next_frame() {
+                    let packet_type = frame[0] >> 4;
+
+                    if packet_type == 3 {
+                        if let Ok(packet) = PublishPacket::decode(&frame) {
+                            let _ =
+                                String::from_utf8(packet.payload).unwrap_or_default();
+                        }
+                    }
+
+                    if packet_type == 4 {
+                        // PUBACK: release the matching inflight slot
+                        if let Ok(packet) = PubAckPacket::decode(&frame) {
+                            inflight.lock().unwrap().acknowledge(packet.packet_id);
+                        }
                     }
                 }
             }
             _ => {
-                *shutdown_flag.lock().unwrap() = true;
+                // Wake the main thread, which is parked on the condvar
+                let (flag, signal) = &*shutdown;
+                *flag.lock().unwrap() = true;
+                signal.notify_all();
+                break;
+            }
+        }
+    }
+}
+
+/// Ping scheduler: parks on the shutdown condvar with a timeout, so it exits
+/// promptly on shutdown and otherwise wakes only to send the keep-alive and
+/// retransmit any QoS 1 publish whose PUBACK is overdue (DUP flag set).
+fn ping_scheduler(
+    mut stream: TcpStream,
+    shutdown: Arc<(Mutex<bool>, Condvar)>,
+    inflight: Arc<Mutex<InflightWindow>>,
+)
+{
+    let (flag, signal) = &*shutdown;
+    let mut done = flag.lock().unwrap();
+
+    while !*done {
+        let (next, timeout) = signal.wait_timeout(done, PING_INTERVAL).unwrap();
+        done = next;
+
+        if timeout.timed_out() && !*done {
+            let ping = PingReqPacket.encode();
+            let _ = stream.write(&ping);
+
+            let stale = inflight.lock().unwrap().stale_frames();
+            for frame in stale {
+                let _ = stream.write(&frame);
+            }
+        }
+    }
+}
+
+/*
+The pub mode below paces itself with whole-second sleeps, so one process can
+offer at most 1 msg/s — useless for stress testing the broker. The load mode
+runs N publisher connections in parallel, each pacing sends at a configurable
+microsecond interval (0 = open loop, as fast as the socket accepts), spreads
+the traffic over a configurable number of topics, and measures the
+publish-to-PUBACK round trip of every message. The summary is one CSV line so
+runs can be appended straight into the same spreadsheets as the mosquitto
+client measurements.
+*/
+
+/// Result of one load-generator connection: messages sent and the observed
+/// publish-to-PUBACK round-trip times in microseconds.
+struct LoadResult {
+    sent: u64,
+    latencies: Vec<u64>,
+}
+
+/// One publisher connection of the load generator.
+fn run_load_connection(
+    worker: usize,
+    payload_size: usize,
+    exec_time: Duration,
+    interval: Duration,
+    topic_count: usize,
+) -> LoadResult {
+    let mut stream = TcpStream::connect(BROKER_ADDR).expect("Connection failed");
+
+    send_connect_packet(
+        stream.try_clone().unwrap(),
+        format!("load-{}-{}", std::process::id(), worker),
+    );
+    receive_connack_packet(stream.try_clone().unwrap());
+
+    // Send timestamps by message ID, shared with the reader thread that
+    // matches PUBACKs and records the round-trip time
+    let pending: Arc<Mutex<HashMap<u16, Instant>>> = Arc::new(Mutex::new(HashMap::new()));
+    let latencies: Arc<Mutex<Vec<u64>>> = Arc::new(Mutex::new(Vec::new()));
+    let done = Arc::new(AtomicBool::new(false));
+
+    let reader_stream = stream.try_clone().unwrap();
+    let reader_pending = Arc::clone(&pending);
+    let reader_latencies = Arc::clone(&latencies);
+    let reader_done = Arc::clone(&done);
+    let reader = thread::spawn(move || {
+        let mut stream = reader_stream;
+        let mut buffer = [0u8; 4096];
+        let mut framer = PacketFramer::new();
+
+        loop {
+            match stream.read(&mut buffer) {
+                Ok(size) if size > 0 => {
+                    framer.extend(&buffer[..size]);
+                    while let Ok(Some(frame)) = framer.next_frame() {
+                        if frame[0] >> 4 == 4 {
+                            // PUBACK: latency is now minus the send time
+                            if let Ok(packet) = PubAckPacket::decode(&frame) {
+                                let sent_at =
+                                    reader_pending.lock().unwrap().remove(&packet.packet_id);
+                                if let Some(sent_at) = sent_at {
+                                    reader_latencies
+                                        .lock()
+                                        .unwrap()
+                                        .push(sent_at.elapsed().as_micros() as u64);
+                                }
+                            }
+                        }
+                    }
+                }
+                _ => break,
+            }
+            if reader_done.load(Ordering::Relaxed) {
                 break;
             }
         }
+    });
+
+    let payload = vec![b'A'; payload_size];
+    let mut sent = 0u64;
+    let mut next_id: u16 = 1;
+    let start = Instant::now();
+
+    // Topic aliases (MQTT 5 property 0x23): the first publish to a topic
+    // carries the full string plus an alias; every repeat sends the two-byte
+    // alias with an empty topic, shaving the string off each frame
+    let mut aliases: HashMap<String, u16> = HashMap::new();
+
+    while start.elapsed() < exec_time {
+        let send_start = Instant::now();
+
+        // Spread traffic over the configured topic cardinality; topic "test"
+        // stays first so plain sub-mode clients still receive messages
+        let topic = if topic_count <= 1 {
+            "test".to_string()
+        } else {
+            format!("test/{}", sent as usize % topic_count)
+        };
+
+        let publish_packet = if let Some(&alias) = aliases.get(&topic) {
+            // Known topic: elide the string, send only the alias
+            let mut packet =
+                PublishPacket::new(String::new(), next_id, 1, false, false, payload.clone());
+            packet.set_topic_alias(alias);
+            packet
+        } else {
+            // First publish to this topic: register the next alias number
+            let alias = aliases.len() as u16 + 1;
+            aliases.insert(topic.clone(), alias);
+            let mut packet =
+                PublishPacket::new(topic, next_id, 1, false, false, payload.clone());
+            packet.set_topic_alias(alias);
+            packet
+        };
+        pending.lock().unwrap().insert(next_id, Instant::now());
+        next_id = if next_id == u16::MAX { 1 } else { next_id + 1 };
+
+        if stream.write_all(&publish_packet.encode()).is_err() {
+            break;
+        }
+        sent += 1;
 
-        thread::sleep(Duration::from_secs(5));
+        // interval zero means open loop: flood as fast as the socket accepts
+        if !interval.is_zero() {
+            let elapsed = send_start.elapsed();
+            if elapsed < interval {
+                thread::sleep(interval - elapsed);
+            }
+        }
     }
+
+    // Give in-flight PUBACKs a moment to drain, then unblock the reader
+    thread::sleep(Duration::from_millis(500));
+    done.store(true, Ordering::Relaxed);
+    let _ = stream.shutdown(Shutdown::Both);
+    let _ = reader.join();
+
+    let latencies = std::mem::take(&mut *latencies.lock().unwrap());
+    LoadResult { sent, latencies }
+}
+
+/// Runs the load generator and prints one CSV summary line.
+/// Usage: client load <connections> <payload> <exec_time> <interval_us> <topics>
+fn run_load_generator(args: &[String]) {
+    let connections: usize = args.get(2).and_then(|s| s.parse().ok()).unwrap_or(1);
+    let payload_size: usize = args.get(3).and_then(|s| s.parse().ok()).unwrap_or(64);
+    let exec_time: u64 = args.get(4).and_then(|s| s.parse().ok()).unwrap_or(10);
+    let interval_us: u64 = args.get(5).and_then(|s| s.parse().ok()).unwrap_or(0);
+    let topic_count: usize = args.get(6).and_then(|s| s.parse().ok()).unwrap_or(1);
+
+    let exec_time = Duration::from_secs(exec_time);
+    let interval = Duration::from_micros(interval_us);
+
+    let handles: Vec<_> = (0..connections)
+        .map(|worker| {
+            thread::spawn(move || {
+                run_load_connection(worker, payload_size, exec_time, interval, topic_count)
+            })
+        })
+        .collect();
+
+    let mut sent = 0u64;
+    let mut latencies: Vec<u64> = Vec::new();
+    for handle in handles {
+        if let Ok(result) = handle.join() {
+            sent += result.sent;
+            latencies.extend(result.latencies);
+        }
+    }
+
+    let seconds = exec_time.as_secs_f64();
+    let throughput = sent as f64 / seconds;
+    let mbps = throughput * payload_size as f64 * 8.0 / 1_000_000.0;
+
+    latencies.sort_unstable();
+    let percentile = |p: f64| -> u64 {
+        if latencies.is_empty() {
+            return 0;
+        }
+        let index = ((latencies.len() as f64 * p).ceil() as usize).min(latencies.len()) - 1;
+        latencies[index]
+    };
+    let avg = if latencies.is_empty() {
+        0
+    } else {
+        latencies.iter().sum::<u64>() / latencies.len() as u64
+    };
+
+    // One header plus one data row, ready to append to the load-test CSVs
+    println!(
+        "connections,payload_bytes,topics,interval_us,messages_sent,acks,\
+throughput_msg_s,throughput_mbps,lat_avg_us,lat_p50_us,lat_p99_us,lat_max_us"
+    );
+    println!(
+        "{},{},{},{},{},{},{:.1},{:.3},{},{},{},{}",
+        connections,
+        payload_size,
+        topic_count,
+        interval_us,
+        sent,
+        latencies.len(),
+        throughput,
+        mbps,
+        avg,
+        percentile(0.50),
+        percentile(0.99),
+        percentile(1.0),
+    );
 }
 
 fn start_client()
@@ -108,13 +405,22 @@ fn start_client()
     let args: Vec<String> = env::args().collect();
     let mode = args.get(1).map(|s| s.as_str()).unwrap_or("sub");
 
-    let shutdown_flag = Arc::new(Mutex::new(false));
+    // Load-generator mode never joins the sub/pub flow below
+    if mode == "load" {
+        run_load_generator(&args);
+        return;
+    }
+
+    // Flag plus condvar, so the main thread sleeps until shutdown instead
+    // of waking every second to poll
+    let shutdown = Arc::new((Mutex::new(false), Condvar::new()));
+    let inflight = Arc::new(Mutex::new(InflightWindow::new()));
 
     let client_id =
         format!("client-{}", std::process::id());
 
     let mut stream =
-        TcpStream::connect("192.168.100.10:1883")
+        TcpStream::connect(BROKER_ADDR)
             .expect("Connection failed");
 
     send_connect_packet(stream.try_clone().unwrap(), client_id);
@@ -157,6 +463,7 @@ fn start_client()
                 stream.try_clone().unwrap(),
                 "test",
                 &payload,
+                &inflight,
             );
 
             message_count += 1;
@@ -172,18 +479,29 @@ fn start_client()
     }
 
     let listener_stream = stream.try_clone().unwrap();
-    let listener_flag = Arc::clone(&shutdown_flag);
+    let listener_shutdown = Arc::clone(&shutdown);
+    let listener_inflight = Arc::clone(&inflight);
 
     thread::spawn(move || {
-        packets_listener(listener_stream, listener_flag);
+        packets_listener(listener_stream, listener_shutdown, listener_inflight);
     });
 
-    loop {
-        if *shutdown_flag.lock().unwrap() {
-            break;
-        }
-        thread::sleep(Duration::from_secs(1));
+    // Keep-alives run on their own schedule, never blocking the reader
+    let pinger_stream = stream.try_clone().unwrap();
+    let pinger_shutdown = Arc::clone(&shutdown);
+    let pinger_inflight = Arc::clone(&inflight);
+
+    thread::spawn(move || {
+        ping_scheduler(pinger_stream, pinger_shutdown, pinger_inflight);
+    });
+
+    // Block until the listener signals shutdown; no periodic polling
+    let (flag, signal) = &*shutdown;
+    let mut done = flag.lock().unwrap();
+    while !*done {
+        done = signal.wait(done).unwrap();
     }
+    drop(done);
 
     send_disconnect_packet(&mut stream);
 }
@@ -1,13 +1,30 @@
-use std::collections::HashMap; // For storing subscriptions per topic
-use std::sync::{Arc, Mutex}; // Provides thread-safe sharing of data between threads
+use std::env; // For reading the accept-path selection from the command line
+use std::collections::HashMap; // Per-connection inbound topic-alias table
+use std::sync::Arc; // Provides thread-safe sharing of data between threads
 use std::net::{TcpListener, TcpStream}; // Provides TCP networking capabilities
 use std::thread; // Provides threading utilities for concurrent execution
-use std::io::{Read, Write}; // Provides I/O traits for reading and writing
-use std::time::{Duration, Instant};
+use std::sync::mpsc; // Channel handing accepted sockets off the accept loop
+use std::os::unix::io::FromRawFd; // Wraps a raw SO_REUSEPORT socket as a TcpListener
+use std::io::Read; // Provides the I/O trait for reading from sockets
+use mqtt_broker::engine::EventEngine; // Event-driven alternative to thread-per-connection
+use mqtt_broker::subscriptions::SubscriptionTable; // Sharded topic subscription table
+use mqtt_broker::framing::PacketFramer; // Splits the TCP byte stream into whole packets
+use mqtt_broker::bufpool::PooledBuf; // Recycled frame buffers (no per-packet Vec)
+use mqtt_broker::metrics; // Relaxed-atomic counters and latency histograms
+use mqtt_broker::admission::admission; // Accept-time flood protection
+use mqtt_broker::persist; // Durable session storage (append-only log)
+use std::time::Instant; // Timestamps the decode-to-fan-out histogram
+use mqtt_broker::retained::RetainedStore; // Last retained message per topic
+use mqtt_broker::session::{Session, SessionRegistry}; // Live sessions keyed by client ID
+use mqtt_broker::timer::TimerWheel; // Central keep-alive enforcement
+use mqtt_broker::subscriptions::filter_matches; // Filter-vs-topic wildcard matching
+use mqtt_broker::outbound::Outbound; // Per-connection outbound queue (vectored writes)
+use bytes::Bytes; // Reference-counted buffer shared across the fan-out loop
+use mqtt_broker::{log_debug, log_error, log_info}; // Ring-buffered, leveled logging
 use mqtt_broker::packets::{
     connect::ConnectPacket, // For handling MQTT CONNECT packets
     connack::{ConnAckPacket, ConnAckReasonCode}, // For creating CONNACK response packets
-    publish::PublishPacket, // For handling MQTT PUBLISH packets
+    publish::{self, PublishPacket, PublishView}, // Lazy PUBLISH header view (payload never copied)
     puback::PubAckPacket,
     subscribe::SubscribePacket,
     suback::SubAckPacket,
@@ -15,39 +32,117 @@ use mqtt_broker::packets::{
     disconnect::{DisconnectPacket, DisconnectReasonCode}
 };
 
-fn send_disconnect_packet(stream: &mut TcpStream, reason_code: DisconnectReasonCode) {
+fn send_disconnect_packet(outbound: &Outbound, reason_code: DisconnectReasonCode) {
     let mut disconnect_packet = DisconnectPacket::new(reason_code);
     disconnect_packet.add_property(0x11, vec![0x01, 0x02]);
 
     let packet = disconnect_packet.encode();
 
-    // Send the Disconnect packet to the server
-    match stream.write(&packet) {
-        Ok(_) => println!("[+]DISCONNECT packet sent: {:?}\n", disconnect_packet),
-        Err(e) => eprintln!("[-]Failed to send DISCONNECT: {}\n", e),
+    // Enqueue the Disconnect packet for the writer thread
+    if outbound.send(Bytes::from(packet)) {
+        log_info!("[+]DISCONNECT packet sent: {:?}\n", disconnect_packet);
+    } else {
+        log_error!("[-]Failed to send DISCONNECT: connection already closed\n");
+    }
+}
+
+/// Reads from the stream until one complete packet frame is buffered.
+/// Returns Ok(None) when the client disconnects before completing a packet.
+fn read_frame(
+    stream: &mut TcpStream,
+    buffer: &mut [u8],
+    framer: &mut PacketFramer,
+) -> Result<Option<PooledBuf>, String> {
+    loop {
+        if let Some(frame) = framer.next_frame()? {
+            return Ok(Some(frame));
+        }
+        match stream.read(&mut *buffer) {
+            Ok(0) => return Ok(None), // Peer closed before a whole packet arrived
+            Ok(size) => framer.extend(&buffer[..size]),
+            Err(e) => return Err(e.to_string()),
+        }
     }
 }
 
 fn handle_client(
     stream: TcpStream,
-    clients: Arc<Mutex<Vec<TcpStream>>>,
-    topic_subscriptions: Arc<Mutex<HashMap<String, Vec<TcpStream>>>>, // Shared subscriptions
-) 
+    sessions: Arc<SessionRegistry>, // Live sessions keyed by client ID
+    topic_subscriptions: Arc<SubscriptionTable>, // Shared sharded subscriptions
+    retained: Arc<RetainedStore>, // Shared retained-message store
+    timers: Arc<TimerWheel>, // Central keep-alive timer wheel
+)
 {
-    let mut stream = stream; // Make the TcpStream mutable to read/write data
-    let mut buffer = [0u8; 1024]; // Buffer to store incoming data
+    let mut stream = stream; // Make the TcpStream mutable to read data
+    let mut buffer = [0u8; 4096]; // Buffer for raw socket reads (may hold several packets)
+    let mut framer = PacketFramer::new(); // Splits the byte stream into whole packets
+
+    // All writes to this client go through its outbound queue, flushed by a
+    // dedicated writer thread with vectored I/O
+    let outbound = Outbound::start(stream.try_clone().expect("Error cloning stream"));
+
+    // Session created once a valid CONNECT is processed
+    let mut session: Option<Arc<Session>> = None;
+
+    // Inbound topic aliases (MQTT 5 property 0x23) registered by this
+    // connection: alias number to full topic string
+    let mut topic_aliases: HashMap<u16, String> = HashMap::new();
 
     // Initial read to check for a CONNECT packet from the client
-    match stream.read(&mut buffer)
+    match read_frame(&mut stream, &mut buffer, &mut framer)
      {
-        Ok(size) if size > 0 => 
+        Ok(Some(frame)) =>
         {
             // Decode the received data as a CONNECT packet
-            match ConnectPacket::decode(&buffer[0..size]) 
+            match ConnectPacket::decode(&frame)
             {
                 Ok(connect_packet) =>
                  {
-                    println!("[+]Received CONNECT packet: {:?}\n", connect_packet);
+                    log_info!("[+]Received CONNECT packet: {:?}\n", connect_packet);
+
+                    // Register the session under its client ID (O(1)); a
+                    // previous session with the same ID is taken over
+                    let new_session = Arc::new(Session::new(
+                        connect_packet.client_id.clone(),
+                        outbound.clone(),
+                        connect_packet.keep_alive,
+                    ));
+                    if let Some(old) = sessions.insert(Arc::clone(&new_session)) {
+                        log_info!("[+]Session taken over for client: {}\n", old.client_id);
+                        old.outbound.shutdown();
+                        old.unsubscribe_all(&topic_subscriptions);
+                    }
+                    // The housekeeping thread now owns this session's
+                    // keep-alive deadline; no polling in this loop
+                    timers.schedule(&new_session);
+                    session = Some(new_session);
+                    metrics::count(&metrics::metrics().connects);
+
+                    // A valid CONNECT arrived: this connection is no longer
+                    // half-open for admission-control purposes
+                    admission().settle();
+
+                    // Clean Session (flag 0x02) wipes the stored state;
+                    // otherwise the client's persisted filters are re-linked
+                    // right here, no re-SUBSCRIBE round trips needed
+                    if connect_packet.connect_flags & 0x02 != 0 {
+                        persist::store().clear(&connect_packet.client_id);
+                    } else {
+                        let saved = persist::store().saved_filters(&connect_packet.client_id);
+                        if !saved.is_empty() {
+                            log_info!(
+                                "[+]Restoring {} subscriptions for client: {}\n",
+                                saved.len(),
+                                connect_packet.client_id
+                            );
+                        }
+                        if let Some(ref session) = session {
+                            for filter in saved {
+                                topic_subscriptions.subscribe(&filter, outbound.clone());
+                                session.add_subscription(&filter);
+                            }
+                        }
+                    }
 
                     // Create a CONNACK packet as a response
                     let connack_packet = ConnAckPacket::new(
@@ -58,77 +153,171 @@ fn handle_client(
 
                     let response = connack_packet.encode(); // Encode the CONNACK packet
 
-                    // Send the CONNACK packet back to the client
-                    match stream.write(&response) 
-                    {
-                        Ok(_) => println!("[+]Sent CONNACK package: {:?}\n", connack_packet),
-                        Err(e) => eprintln!("[-]Error sending the CONNACK package: {}\n", e),
+                    // Enqueue the CONNACK packet for the client
+                    if outbound.send(Bytes::from(response)) {
+                        log_info!("[+]Sent CONNACK package: {:?}\n", connack_packet);
+                    } else {
+                        log_error!("[-]Error sending the CONNACK package: connection closed\n");
                     }
                 }
-                Err(e) => eprintln!("[-]Error decoding CONNECT: {}\n", e), // Log decoding errors
+                Err(e) => log_error!("[-]Error decoding CONNECT: {}\n", e), // Log decoding errors
             }
         }
-        Ok(_) => println!("[+]Client disconnected: {:?}\n", stream.peer_addr()), // Handle empty read (disconnection)
-        Err(e) => println!("[-]Error reading from stream: {}\n", e), // Log reading errors
+        Ok(None) => log_info!("[+]Client disconnected: {:?}\n", stream.peer_addr()), // Handle empty read (disconnection)
+        Err(e) => log_error!("[-]Error reading from stream: {}\n", e), // Log reading errors
     }
 
-    //Starting ping time
-    let mut last_ping_time = Instant::now();
-
-    // Enter a loop to continuously read packets from the client
-    loop 
+    // Enter a loop to continuously process packets from the client
+    loop
     {
-        match stream.read(&mut buffer) 
+        let mut should_close = false;
+
+        // Drain every complete packet already buffered before blocking on
+        // the socket: the initial CONNECT read returns after the first whole
+        // packet, so a client that pipelines CONNECT+SUBSCRIBE in one
+        // segment would otherwise have its SUBSCRIBE sit in the framer until
+        // its next write (the epoll path already drains like this)
+        loop
         {
-            Ok(size) if size > 0 => 
-            {
-                // Determine packet type (for demonstration; replace with actual packet identification logic)
-                let packet_type = buffer[0] >> 4; // MQTT packet type is in the top 4 bits of the first byte.
+                let frame = match framer.next_frame()
+                {
+                    Ok(Some(frame)) => frame,
+                    Ok(None) => break, // No complete packet buffered yet
+                    Err(e) =>
+                    {
+                        log_error!("[-]Malformed packet from client: {}\n", e);
+                        should_close = true;
+                        break;
+                    }
+                };
 
-                match packet_type 
+                let packet_type = frame[0] >> 4; // MQTT packet type is in the top 4 bits of the first byte.
+
+                // Any inbound packet proves the client is alive; the timer
+                // wheel reads this timestamp when the deadline comes due
+                if let Some(ref session) = session {
+                    session.touch();
+                }
+
+                match packet_type
                 {
                     3 => 
                     {
-                        // PUBLISH packet
-                        if let Ok(packet) = PublishPacket::decode(&buffer[..size]) 
+                        // PUBLISH packet: only the header is parsed; topic
+                        // and payload stay borrowed from the frame
+                        let decode_start = Instant::now();
+                        if let Ok(packet) = PublishView::parse(&frame) 
                         {
-                            println!("[+]Received PUBLISH packet: {:?}\n", packet);
-                        
+                            log_debug!("[+]Received PUBLISH packet: {:?}\n", packet);
+                            metrics::count(&metrics::metrics().publishes_in);
+
+                            // Resolve the topic through this connection's
+                            // alias table: a full topic registers its alias,
+                            // an empty topic reuses the remembered one
+                            let topic = match publish::resolve_topic_alias(
+                                packet.topic_name,
+                                packet.topic_alias,
+                                &mut topic_aliases,
+                            ) {
+                                Some(topic) => topic,
+                                None =>
+                                {
+                                    log_error!("[-]PUBLISH with unknown topic alias; dropping\n");
+                                    continue;
+                                }
+                            };
+
                             // Send PUBACK packet back to the sender
                             let puback_packet = PubAckPacket::new(packet.message_id);
                             let puback_response = puback_packet.encode();
-                            match stream.write(&puback_response) 
-                            {
-                                Ok(_) => println!("[+]Sent PUBACK packet for message ID: {}\n", packet.message_id),
-                                Err(e) => eprintln!("[-]Error sending PUBACK packet: {}\n", e),
+                            if outbound.send(Bytes::from(puback_response)) {
+                                log_debug!("[+]Sent PUBACK packet for message ID: {}\n", packet.message_id);
+                            } else {
+                                log_error!("[-]Error sending PUBACK packet: connection closed\n");
                             }
                         
-                            // Retrieve subscribers for the topic
-                            let topic_subscriptions_guard = topic_subscriptions.lock().unwrap(); // Lock the subscription list
-                            if let Some(subscribers) = topic_subscriptions_guard.get(&packet.topic_name) {
-                                for mut subscriber in subscribers.iter() {
-                                    if subscriber.peer_addr().unwrap() != stream.peer_addr().unwrap() {
-                                        // Encode the entire PUBLISH packet
-                                        let publish_response = packet.encode(); 
-                                        match subscriber.write(&publish_response) {
-                                            Ok(_) => println!("[+]Sent PUBLISH packet to subscriber: {:?}\n", subscriber.peer_addr()),
-                                            Err(e) => eprintln!("[-]Error sending PUBLISH packet: {}\n", e),
+                            // The broker forwards the PUBLISH unmodified, so the
+                            // inbound wire bytes are captured once in a shared
+                            // buffer instead of re-encoding per subscriber.
+                            // An aliased frame is re-expanded first, because
+                            // subscribers do not share this connection's table
+                            let publish_response = if packet.topic_name.is_empty() {
+                                Bytes::from(PublishPacket::new(
+                                    topic.to_string(),
+                                    packet.message_id,
+                                    packet.qos,
+                                    packet.retain,
+                                    packet.dup,
+                                    packet.payload.to_vec(),
+                                ).encode())
+                            } else {
+                                Bytes::copy_from_slice(&frame)
+                            };
+
+                            // Remember (or clear) the retained message so new
+                            // subscribers get the last known value immediately
+                            if packet.retain {
+                                if packet.payload.is_empty() {
+                                    retained.clear(topic);
+                                } else {
+                                    retained.store(topic, publish_response.clone());
+                                }
+                            }
+
+                            // Fan the message out under the shard's read lock
+                            // (publishes to other topics are never blocked)
+                            let mut saw_dead = false;
+                            let had_subscribers = topic_subscriptions
+                                .for_each_subscriber(topic, |subscriber| {
+                                    // Cached numeric IDs: no getpeername(2)
+                                    // syscall inside the broadcast loop
+                                    if subscriber.id() != outbound.id() {
+                                        // Enqueue only: the subscriber's writer
+                                        // thread performs the network write.
+                                        // QoS 1 deliveries get a message ID from
+                                        // the subscriber's inflight window
+                                        // The Message Expiry Interval rides
+                                        // along so a queued frame can expire
+                                        let delivered = if packet.qos > 0 {
+                                            subscriber.send_qos1(&publish_response, packet.message_expiry)
+                                        } else {
+                                            subscriber.send_expiring(publish_response.clone(), packet.message_expiry)
+                                        };
+                                        if delivered {
+                                            metrics::count(&metrics::metrics().publishes_out);
+                                            log_debug!("[+]Sent PUBLISH packet to subscriber: {:?}\n", subscriber.peer_addr());
+                                        } else {
+                                            metrics::count(&metrics::metrics().dropped_writes);
+                                            log_debug!("[-]Subscriber unavailable; dropping PUBLISH\n");
+                                            saw_dead |= subscriber.is_dead();
                                         }
                                     }
-                                }
-                                println!("Message sent to topic: {}\n", packet.topic_name);
+                                });
+                            // Lazy eviction: a failed delivery to a dead
+                            // connection triggers a sweep of this topic's
+                            // shard so the list does not rot until disconnect
+                            if saw_dead {
+                                topic_subscriptions.evict_dead(topic);
+                            }
+                            if had_subscribers {
+                                log_debug!("Message sent to topic: {}\n", topic);
                             } else {
-                                println!("No subscribers for topic: {}\n", packet.topic_name);
+                                log_debug!("No subscribers for topic: {}\n", topic);
                             }
+
+                            // Decode-to-fan-out time for this PUBLISH
+                            metrics::metrics()
+                                .fanout_latency
+                                .record_us(decode_start.elapsed().as_micros() as u64);
                         } 
                     }
                 
                     8 => 
                     {
                         // SUBSCRIBE packet
-                        if let Ok(packet) = SubscribePacket::decode(&buffer[..size]) 
+                        if let Ok(packet) = SubscribePacket::decode(&frame) 
                         {
-                            println!("[+]Received SUBSCRIBE packet: {:?}\n", packet);
+                            log_debug!("[+]Received SUBSCRIBE packet: {:?}\n", packet);
                             // Prepare return codes for the subscription
                             let return_codes: Vec<u8> = packet
                             .qos_values
@@ -151,132 +340,405 @@ fn handle_client(
                             // Encode the SUBACK packet (assume an `encode` method exists)
                             let suback_response = suback_packet.encode(); 
 
-                            // Send the SUBACK packet back to the client
-                            match stream.write(&suback_response) 
-                            {
-                                Ok(_) => println!("[+]Sent SUBACK : {:?}\n", suback_response),
-                                Err(e) => eprintln!("[-]Error sending SUBACK packet: {}\n", e),
+                            // Enqueue the SUBACK packet for the client
+                            if outbound.send(Bytes::from(suback_response.clone())) {
+                                log_debug!("[+]Sent SUBACK : {:?}\n", suback_response);
+                            } else {
+                                log_error!("[-]Error sending SUBACK packet: connection closed\n");
                             }
 
                             // Add client to the topic subscriptions
-                            let mut subscriptions = topic_subscriptions.lock().unwrap();
+                            // (only the shard owning each topic is locked)
                             for topic in packet.topic_filters.iter() {
-                                subscriptions
-                                    .entry(topic.clone())
-                                    .or_insert_with(Vec::new)
-                                    .push(stream.try_clone().unwrap());
-                                println!("A client added to topic list: {}\n", topic);
+                                topic_subscriptions.subscribe(topic, outbound.clone());
+                                if let Some(ref session) = session {
+                                    session.add_subscription(topic);
+                                    // Durable: survives a broker restart
+                                    persist::store().record_subscribe(&session.client_id, topic);
+                                }
+                                log_info!("A client added to topic list: {}\n", topic);
+                            }
+
+                            // Deliver retained messages matching the new
+                            // filters from a lock-free snapshot of the store
+                            let snapshot = retained.snapshot();
+                            for (topic, frame) in snapshot.iter() {
+                                let wanted = packet
+                                    .topic_filters
+                                    .iter()
+                                    .any(|filter| filter_matches(filter, topic));
+                                if wanted && outbound.send(frame.clone()) {
+                                    log_debug!("[+]Sent retained message for topic: {}\n", topic);
+                                }
                             }
                         }
                     }
-                    12 => 
+                    4 =>
                     {
+                        // PUBACK from the client for a QoS 1 message the
+                        // broker delivered: release its inflight slot
+                        if let Ok(packet) = PubAckPacket::decode(&frame) {
+                            if outbound.acknowledge(packet.packet_id) {
+                                log_debug!("[+]PUBACK received for message ID: {}\n", packet.packet_id);
+                            } else {
+                                log_debug!("[-]PUBACK for unknown message ID: {}\n", packet.packet_id);
+                            }
+                        }
+                    }
 
-                        // Valid PINGREQ packet received
-                        last_ping_time = Instant::now(); // Update the timestamp when PINGREQ is received
+                    12 => 
+                    {
 
-                        // Respond with PINGRESP packet
+                        // Valid PINGREQ packet received; respond with PINGRESP
                         let pingresp_packet = PingRespPacket; // Create an instance of PingRespPacket
                         let pingresp_response = pingresp_packet.encode(); // Encode the PINGRESP packet
-                        match stream.write(&pingresp_response) {
-                            Ok(_) => {},
-                            Err(e) => eprintln!("[-]Error sending PINGRESP packet: {}\n", e),
+                        if !outbound.send(pingresp_response.freeze()) {
+                            log_error!("[-]Error sending PINGRESP packet: connection closed\n");
                         }
                         
                     }
 
                     14 => 
                     {
-                        if let Ok(packet) = DisconnectPacket::decode(&buffer[..size]) {
-                            println!("[+]Received DISCONNECT packet: {:?}\n", packet);
-                            break;
+                        if let Ok(packet) = DisconnectPacket::decode(&frame) {
+                            log_debug!("[+]Received DISCONNECT packet: {:?}\n", packet);
+                            should_close = true;
                         }
                     }
 
                     _ => {
-                        println!("[-]Unknown or unsupported packet type: {}\n", packet_type);
+                        log_debug!("[-]Unknown or unsupported packet type: {}\n", packet_type);
                     }
                 }
 
-                if last_ping_time.elapsed() > Duration::from_secs(60) 
-                {
-                    send_disconnect_packet(&mut stream, DisconnectReasonCode::KeepAliveTimeout);
-                    println!("[-]No PINGREQ received for over 60 seconds. Closing connection.\n");
+                if should_close {
                     break;
                 }
+        } // End of the per-frame loop
+
+        if should_close {
+            break;
+        }
+
+        match stream.read(&mut buffer)
+        {
+            Ok(size) if size > 0 =>
+            {
+                metrics::add(&metrics::metrics().bytes_in, size as u64);
 
+                // Buffer the raw bytes; one read may carry several packets,
+                // or only part of a large one
+                framer.extend(&buffer[..size]);
             }
-            Ok(_) => 
+            Ok(_) =>
             {
-                send_disconnect_packet(&mut stream, DisconnectReasonCode::NormalDisconnection);
-                println!("[+]Client disconnected: {:?}\n", stream.peer_addr()); // Handle client disconnection
+                send_disconnect_packet(&outbound, DisconnectReasonCode::NormalDisconnection);
+                log_info!("[+]Client disconnected: {:?}\n", stream.peer_addr()); // Handle client disconnection
                 break;
             }
             Err(e) => 
             {
-                eprintln!("[-]Error reading from stream: {}\n", e); // Log reading errors
+                log_error!("[-]Error reading from stream: {}\n", e); // Log reading errors
                 break;
             }
         }
     }
 
-    // Remove the disconnected client from the shared client list
-    let mut clients_guard = clients.lock().unwrap();
-    if let Some(pos) = clients_guard.iter().position(|x| 
+    // Let the writer thread drain and exit
+    outbound.shutdown();
+
+    // A connection that never produced a valid CONNECT still holds its
+    // half-open admission slot; release it on the way out
+    if session.is_none() {
+        admission().settle();
+    }
+
+    // Unregister the session in O(1) instead of scanning every connection,
+    // and unlink it from every topic list it subscribed to. The removal is
+    // conditional on identity: after a takeover the registry holds the NEW
+    // session under this client ID, which must stay registered
+    if let Some(session) = session {
+        session.unsubscribe_all(&topic_subscriptions);
+        sessions.remove_if_current(&session);
+    }
+}
+
+/*
+A single listener funnels every accept through one kernel accept queue and
+one thread. With SO_REUSEPORT, several sockets bind the same port and the
+kernel hashes incoming connections across their queues, so accept work
+spreads over as many threads (and cores) as there are listeners while the
+worker pool, session registry and subscription table stay shared behind
+them. std::net cannot set SO_REUSEPORT before bind, so the socket is built
+through libc and handed back as an ordinary TcpListener.
+*/
+
+/// Binds 0.0.0.0:<port> with SO_REUSEPORT set, so several listeners can
+/// share the port. Returns None (with a log) when any syscall fails.
+fn bind_reuseport(port: u16) -> Option<TcpListener> {
+    unsafe {
+        let fd = libc::socket(libc::AF_INET, libc::SOCK_STREAM, 0);
+        if fd < 0 {
+            log_error!("[-]Error creating listener socket\n");
+            return None;
+        }
+
+        let one: libc::c_int = 1;
+        let optlen = std::mem::size_of::<libc::c_int>() as libc::socklen_t;
+        libc::setsockopt(
+            fd,
+            libc::SOL_SOCKET,
+            libc::SO_REUSEADDR,
+            &one as *const _ as *const libc::c_void,
+            optlen,
+        );
+        if libc::setsockopt(
+            fd,
+            libc::SOL_SOCKET,
+            libc::SO_REUSEPORT,
+            &one as *const _ as *const libc::c_void,
+            optlen,
+        ) < 0
         {
-        match x.peer_addr()
-         {
-            Ok(addr) => addr == stream.peer_addr().unwrap_or_else(|_| "0.0.0.0:0".parse().unwrap()), // Fallback to default address if error
-            Err(_) => false, // Ignore if peer address retrieval fails
+            log_error!("[-]Error setting SO_REUSEPORT\n");
+            libc::close(fd);
+            return None;
         }
-    }) 
-    {
-        clients_guard.remove(pos);
+
+        let mut addr: libc::sockaddr_in = std::mem::zeroed();
+        addr.sin_family = libc::AF_INET as libc::sa_family_t;
+        addr.sin_port = port.to_be();
+        addr.sin_addr.s_addr = libc::INADDR_ANY; // 0.0.0.0
+
+        if libc::bind(
+            fd,
+            &addr as *const _ as *const libc::sockaddr,
+            std::mem::size_of::<libc::sockaddr_in>() as libc::socklen_t,
+        ) < 0
+        {
+            log_error!("[-]Error binding listener on port {}\n", port);
+            libc::close(fd);
+            return None;
+        }
+        if libc::listen(fd, 1024) < 0 {
+            log_error!("[-]Error listening on port {}\n", port);
+            libc::close(fd);
+            return None;
+        }
+
+        Some(TcpListener::from_raw_fd(fd))
     }
 }
 
-// Function to start the MQTT server
-fn start_server() 
-{
-    // Bind the server to a local address and port
-    let listener = TcpListener::bind("0.0.0.0:1883").expect("Error starting the server"); 
-    println!("\nMQTT server started on 0.0.0.0:1883\n");
-
-    // Shared list of connected clients
-    let clients: Arc<Mutex<Vec<TcpStream>>> = Arc::new(Mutex::new(Vec::new())); 
-    let topic_subscriptions: Arc<Mutex<HashMap<String, Vec<TcpStream>>>> =
-        Arc::new(Mutex::new(HashMap::new()));
+/// Binds the requested number of listeners on port 1883: one plain listener
+/// when count is 1, otherwise one SO_REUSEPORT socket per accept thread.
+fn bind_listeners(count: usize) -> Vec<TcpListener> {
+    if count <= 1 {
+        return vec![TcpListener::bind("0.0.0.0:1883").expect("Error starting the server")];
+    }
+    let mut listeners = Vec::with_capacity(count);
+    for _ in 0..count {
+        match bind_reuseport(1883) {
+            Some(listener) => listeners.push(listener),
+            None => std::process::exit(1),
+        }
+    }
+    listeners
+}
 
-    // Accept incoming connections in a loop
-    for stream in listener.incoming() 
+/// One accept loop for the thread-per-connection path: admission check plus
+/// a channel send per socket, nothing else.
+fn run_accept_loop(listener: TcpListener, dispatch_tx: mpsc::Sender<TcpStream>) {
+    for stream in listener.incoming()
     {
         match stream 
         {
-            Ok(stream) => 
+            // Hand the raw socket straight to the dispatcher and go back to
+            // accepting; the only work left on this path is the O(1)
+            // admission check against the fixed-size bucket table
+            Ok(stream) =>
             {
-                println!("[+]Client connected: {:?}\n", stream.peer_addr());
-
-                // Lock the client list for modification
-                let mut clients_guard = clients.lock().unwrap(); 
-                // Add the new client to the list
-                clients_guard.push(stream.try_clone().unwrap()); 
-
-                // Create a clone of the client list for the new thread
-                let clients_clone = Arc::clone(&clients); 
-                let subscriptions_clone = Arc::clone(&topic_subscriptions);
-                thread::spawn(move || {
-                    // Handle the client in a separate thread
-                    handle_client(stream, clients_clone, subscriptions_clone);
-                });
+                // A socket whose peer address cannot be read (usually reset
+                // mid-accept) is dropped outright: it cannot be charged to a
+                // bucket, and letting it through without claiming a
+                // half-open slot would make the unconditional settle() on
+                // disconnect underflow the counter and wedge admission
+                let addr = match stream.peer_addr() {
+                    Ok(addr) => addr,
+                    Err(e) => {
+                        log_error!("[-]Error reading peer address: {}; dropping connection\n", e);
+                        continue;
+                    }
+                };
+                if !admission().admit(addr.ip()) {
+                    continue;
+                }
+                if dispatch_tx.send(stream).is_err() {
+                    // The admitted socket is dropped with the send error, so
+                    // its half-open slot goes back too
+                    admission().settle();
+                    log_error!("[-]Connection dispatcher is gone; stopping accept loop\n");
+                    break;
+                }
             }
             Err(e) => 
             {
-                println!("[-]Error accepting connection: {}\n", e); // Log errors during connection acceptance
+                log_error!("[-]Error accepting connection: {}\n", e); // Log errors during connection acceptance
             }
         }
     }
 }
 
+/// One accept loop for the epoll path: admission check plus a dispatch into
+/// the shared worker pool.
+fn run_accept_loop_epoll(listener: TcpListener, engine: Arc<EventEngine>) {
+    for stream in listener.incoming()
+    {
+        match stream
+        {
+            // Hand the socket to a worker; it multiplexes many connections
+            Ok(stream) =>
+            {
+                // Token-bucket and half-open checks before any setup;
+                // dropping the stream here closes the socket. A peer address
+                // that cannot be read means the socket is already gone —
+                // drop it before it claims (or dodges) a half-open slot
+                let addr = match stream.peer_addr() {
+                    Ok(addr) => addr,
+                    Err(e) => {
+                        log_error!("[-]Error reading peer address: {}; dropping connection\n", e);
+                        continue;
+                    }
+                };
+                if !admission().admit(addr.ip()) {
+                    continue;
+                }
+                engine.dispatch(stream)
+            }
+            Err(e) => log_error!("[-]Error accepting connection: {}\n", e),
+        }
+    }
+}
+
+// Function to start the MQTT server
+fn start_server()
+{
+    // Live sessions keyed by the client ID from their CONNECT packet
+    let sessions: Arc<SessionRegistry> = Arc::new(SessionRegistry::new());
+    // Sharded subscription table: publishes to different topics never contend
+    let topic_subscriptions: Arc<SubscriptionTable> = Arc::new(SubscriptionTable::new());
+    // Retained messages delivered to new subscribers on SUBSCRIBE
+    let retained: Arc<RetainedStore> = Arc::new(RetainedStore::new());
+    // One housekeeping thread enforces every session's keep-alive deadline
+    let timers: Arc<TimerWheel> = TimerWheel::start();
+    // Periodic $SYS/broker/metrics snapshots for any subscribed client
+    metrics::start_reporter(Arc::clone(&topic_subscriptions));
+
+    // Optional bridge link to a peer broker, configured via MQTT_BRIDGE_PEER
+    // and MQTT_BRIDGE_FILTERS; composes with every accept mode below
+    if let Some((peer, filters)) = mqtt_broker::bridge::config_from_env() {
+        mqtt_broker::bridge::start(
+            peer,
+            filters,
+            Arc::clone(&topic_subscriptions),
+            Arc::clone(&retained),
+        );
+    }
+
+    // Alternative accept path: "server epoll [workers] [listeners]" runs a
+    // fixed pool of event-loop workers instead of a thread per connection;
+    // "server [listeners]" keeps the thread path but spreads accepts over
+    // several SO_REUSEPORT listeners
+    let args: Vec<String> = env::args().collect();
+    if args.get(1).map(|s| s.as_str()) == Some("epoll")
+    {
+        let workers: usize = args
+            .get(2)
+            .and_then(|s| s.parse().ok())
+            .unwrap_or(4);
+        let listeners: usize = args
+            .get(3)
+            .and_then(|s| s.parse().ok())
+            .unwrap_or(1);
+
+        log_info!(
+            "[+]Using event-loop engine with {} workers, {} listeners\n",
+            workers,
+            listeners
+        );
+        let engine = Arc::new(EventEngine::start(
+            workers,
+            Arc::clone(&topic_subscriptions),
+            Arc::clone(&retained),
+            Arc::clone(&sessions),
+            Arc::clone(&timers),
+        ));
+
+        let mut sockets = bind_listeners(listeners);
+        println!("\nMQTT server started on 0.0.0.0:1883 ({} listeners)\n", sockets.len());
+
+        // All but the last listener accept on their own threads; the kernel
+        // spreads incoming connections across the listening sockets
+        let last = sockets.pop().unwrap();
+        for socket in sockets {
+            let engine = Arc::clone(&engine);
+            thread::spawn(move || run_accept_loop_epoll(socket, engine));
+        }
+        run_accept_loop_epoll(last, engine);
+        return;
+    }
+
+    let listeners: usize = args
+        .get(1)
+        .and_then(|s| s.parse().ok())
+        .unwrap_or(1);
+
+    // The accept loops do nothing but accept(2) and a channel send; the
+    // dispatcher thread below absorbs everything else (peer-address lookup,
+    // logging, Arc clones, thread spawn), so a reconnect storm is drained at
+    // the rate the kernel can hand over sockets instead of being serialized
+    // behind per-connection setup
+    let (dispatch_tx, dispatch_rx) = mpsc::channel::<TcpStream>();
+
+    let sessions_clone = Arc::clone(&sessions);
+    let subscriptions_clone = Arc::clone(&topic_subscriptions);
+    let retained_clone = Arc::clone(&retained);
+    let timers_clone = Arc::clone(&timers);
+    thread::spawn(move || {
+        // Per-connection setup runs here, off the accept path; the reader
+        // thread it spawns parses CONNECT and sends CONNACK as before
+        for stream in dispatch_rx {
+            log_info!("[+]Client connected: {:?}\n", stream.peer_addr());
+
+            let sessions_clone = Arc::clone(&sessions_clone);
+            let subscriptions_clone = Arc::clone(&subscriptions_clone);
+            let retained_clone = Arc::clone(&retained_clone);
+            let timers_clone = Arc::clone(&timers_clone);
+            thread::spawn(move || {
+                handle_client(
+                    stream,
+                    sessions_clone,
+                    subscriptions_clone,
+                    retained_clone,
+                    timers_clone,
+                );
+            });
+        }
+    });
+
+    let mut sockets = bind_listeners(listeners);
+    println!("\nMQTT server started on 0.0.0.0:1883 ({} listeners)\n", sockets.len());
+
+    // All but the last listener accept on their own threads; the kernel
+    // spreads incoming connections across the listening sockets
+    let last = sockets.pop().unwrap();
+    for socket in sockets {
+        let dispatch_tx = dispatch_tx.clone();
+        thread::spawn(move || run_accept_loop(socket, dispatch_tx));
+    }
+    run_accept_loop(last, dispatch_tx);
+}
+
 // Entry point of the application
 fn main() {
     start_server(); // Start the MQTT server
@@ -0,0 +1,214 @@
+/// Inter-broker bridge: dials a peer and forwards matched publishes.
+
+/*
+Bridging two sites with an external client script forwards every message as
+its own small TCP write, so the cross-site link carries one packet per
+message. The native bridge reuses the broker's own machinery instead: the
+link's outbound side is an ordinary Outbound queue subscribed into the local
+topic table, so matched publishes are coalesced by its writer thread's
+write_vectored batches — many MQTT packets per TCP segment — with no code
+specific to the bridge. The inbound side reads the peer's publishes through
+the normal framer and fans them out locally, excluding the bridge's own
+queue so nothing echoes back over the link.
+
+The bridge is configured through the environment so it composes with every
+accept mode:
+    MQTT_BRIDGE_PEER     address to dial, e.g. 10.0.0.2:1883
+    MQTT_BRIDGE_FILTERS  comma-separated topic filters to replay (default #)
+It reconnects with a fixed backoff when the link drops, and keeps the link
+alive with periodic PINGREQs like any client.
+*/
+
+use std::net::TcpStream;
+use std::sync::Arc;
+use std::thread;
+use std::time::Duration;
+
+use bytes::Bytes;
+
+use crate::framing::PacketFramer;
+use crate::metrics;
+use crate::outbound::Outbound;
+use crate::packets::connect::ConnectPacket;
+use crate::packets::ping::PingReqPacket;
+use crate::packets::publish::PublishView;
+use crate::packets::subscribe::SubscribePacket;
+use crate::retained::RetainedStore;
+use crate::subscriptions::SubscriptionTable;
+use crate::{log_error, log_info};
+
+/// How long to wait before redialing a failed link.
+const RECONNECT_BACKOFF: Duration = Duration::from_secs(5);
+
+/// Keep-alive negotiated for the link, in seconds; PINGREQs go out at half
+/// this interval.
+const BRIDGE_KEEP_ALIVE: u16 = 60;
+
+/// Reads the bridge configuration from the environment; None when no peer
+/// is configured and the broker should run standalone.
+pub fn config_from_env() -> Option<(String, Vec<String>)> {
+    let peer = std::env::var("MQTT_BRIDGE_PEER").ok()?;
+    let filters: Vec<String> = std::env::var("MQTT_BRIDGE_FILTERS")
+        .unwrap_or_else(|_| "#".to_string())
+        .split(',')
+        .map(|f| f.trim().to_string())
+        .filter(|f| !f.is_empty())
+        .collect();
+    Some((peer, filters))
+}
+
+/// Spawns the bridge thread: dials the peer, replays the filters, and keeps
+/// the link up for the life of the process.
+pub fn start(
+    peer: String,
+    filters: Vec<String>,
+    topic_subscriptions: Arc<SubscriptionTable>,
+    retained: Arc<RetainedStore>,
+) {
+    thread::spawn(move || loop {
+        match TcpStream::connect(&peer) {
+            Ok(stream) => {
+                log_info!("[+]Bridge link established to {}\n", peer);
+                run_link(stream, &filters, &topic_subscriptions, &retained);
+                log_info!("[-]Bridge link to {} lost; redialing\n", peer);
+            }
+            Err(e) => log_error!("[-]Error dialing bridge peer {}: {}\n", peer, e),
+        }
+        thread::sleep(RECONNECT_BACKOFF);
+    });
+}
+
+/// Runs one session over an established link; returns when the link drops.
+fn run_link(
+    mut stream: TcpStream,
+    filters: &[String],
+    topic_subscriptions: &Arc<SubscriptionTable>,
+    retained: &Arc<RetainedStore>,
+) {
+    let outbound = match stream.try_clone() {
+        Ok(write_side) => Outbound::start(write_side),
+        Err(e) => {
+            log_error!("[-]Error cloning bridge stream: {}\n", e);
+            return;
+        }
+    };
+
+    // CONNECT, then replay every configured filter as one SUBSCRIBE packet
+    let connect_packet = ConnectPacket::new(
+        "MQTT".to_string(),
+        5,
+        0b00000010,
+        BRIDGE_KEEP_ALIVE,
+        format!("bridge-{}", std::process::id()),
+        None,
+        None,
+        None,
+        None,
+    );
+    outbound.send(Bytes::from(connect_packet.encode()));
+
+    let subscribe_packet = SubscribePacket::new(
+        1,
+        filters.to_vec(),
+        vec![0; filters.len()],
+    );
+    outbound.send(Bytes::from(subscribe_packet.encode()));
+
+    // Local publishes matching the filters flow to the peer through this
+    // queue, where the writer thread coalesces them into vectored writes
+    for filter in filters {
+        topic_subscriptions.subscribe(filter, outbound.clone());
+    }
+
+    // Keep-alive for the link: PINGREQs from a small side thread that exits
+    // once the queue is marked dead
+    let ping_outbound = outbound.clone();
+    thread::spawn(move || {
+        let interval = Duration::from_secs(BRIDGE_KEEP_ALIVE as u64 / 2);
+        loop {
+            thread::sleep(interval);
+            if !ping_outbound.send(PingReqPacket.encode().freeze()) {
+                return;
+            }
+        }
+    });
+
+    // Inbound side: fan the peer's publishes out locally, never back over
+    // the link
+    let mut buffer = [0u8; 4096];
+    let mut framer = PacketFramer::new();
+    loop {
+        use std::io::Read;
+        match stream.read(&mut buffer) {
+            Ok(size) if size > 0 => {
+                framer.extend(&buffer[..size]);
+                loop {
+                    let frame = match framer.next_frame() {
+                        Ok(Some(frame)) => frame,
+                        Ok(None) => break,
+                        Err(e) => {
+                            log_error!("[-]Malformed packet on bridge link: {}\n", e);
+                            cleanup(&outbound, filters, topic_subscriptions);
+                            return;
+                        }
+                    };
+                    if frame[0] >> 4 == 3 {
+                        forward_publish(&frame, &outbound, topic_subscriptions, retained);
+                    }
+                    // CONNACK, SUBACK and PINGRESP need no handling here
+                }
+            }
+            _ => {
+                cleanup(&outbound, filters, topic_subscriptions);
+                return;
+            }
+        }
+    }
+}
+
+/// Publishes one frame from the peer into the local fan-out, skipping the
+/// bridge's own queue so it cannot echo back over the link.
+fn forward_publish(
+    frame: &[u8],
+    outbound: &Outbound,
+    topic_subscriptions: &SubscriptionTable,
+    retained: &RetainedStore,
+) {
+    let packet = match PublishView::parse(frame) {
+        Ok(packet) => packet,
+        Err(e) => {
+            log_error!("[-]Error decoding bridged PUBLISH: {}\n", e);
+            return;
+        }
+    };
+    metrics::count(&metrics::metrics().publishes_in);
+
+    let publish_response = Bytes::copy_from_slice(frame);
+
+    if packet.retain {
+        if packet.payload.is_empty() {
+            retained.clear(packet.topic_name);
+        } else {
+            retained.store(packet.topic_name, publish_response.clone());
+        }
+    }
+
+    topic_subscriptions.for_each_subscriber(packet.topic_name, |subscriber| {
+        if subscriber.id() != outbound.id() {
+            if subscriber.send_expiring(publish_response.clone(), packet.message_expiry) {
+                metrics::count(&metrics::metrics().publishes_out);
+            } else {
+                metrics::count(&metrics::metrics().dropped_writes);
+            }
+        }
+    });
+}
+
+/// Unlinks the bridge queue from the local table and shuts it down; called
+/// whenever the link drops so redial starts from a clean slate.
+fn cleanup(outbound: &Outbound, filters: &[String], topic_subscriptions: &SubscriptionTable) {
+    for filter in filters {
+        topic_subscriptions.unsubscribe(filter, outbound.id());
+    }
+    outbound.shutdown();
+}
@@ -0,0 +1,80 @@
+/// Reusable byte-buffer pool for the packet hot path.
+
+/*
+Every frame handed out by the framer used to be a fresh Vec, and the decode
+and encode paths allocate more scratch buffers of their own; at tens of
+thousands of messages per second that is a constant stream of short-lived heap
+allocations, all of roughly the same size.
+
+The pool keeps a bounded free list of cleared buffers. Acquiring one reuses a
+previous allocation (the buffer keeps its grown capacity), and dropping the
+PooledBuf guard returns it automatically, so steady-state traffic recycles the
+same few buffers instead of touching the allocator per packet. Buffers that
+grew unusually large are released rather than pooled, so one oversized packet
+cannot pin memory forever.
+*/
+
+use std::ops::{Deref, DerefMut};
+use std::sync::{Mutex, OnceLock};
+
+/// Upper bound on buffers kept in the free list; beyond this they are freed.
+const MAX_POOLED: usize = 256;
+
+/// Buffers that grew past this capacity are dropped instead of pooled, so a
+/// single huge packet does not keep its allocation alive forever.
+const MAX_RETAINED_CAPACITY: usize = 64 * 1024;
+
+/// The process-wide free list, created on first use.
+static POOL: OnceLock<Mutex<Vec<Vec<u8>>>> = OnceLock::new();
+
+fn free_list() -> &'static Mutex<Vec<Vec<u8>>> {
+    POOL.get_or_init(|| Mutex::new(Vec::new()))
+}
+
+/// A pooled buffer; behaves like a Vec<u8> and returns itself to the pool
+/// when dropped.
+pub struct PooledBuf {
+    buf: Vec<u8>,
+}
+
+impl PooledBuf {
+    /// Consumes the guard and takes the buffer out of the pool's control,
+    /// for the rare case where the bytes must outlive the guard.
+    pub fn into_vec(mut self) -> Vec<u8> {
+        std::mem::take(&mut self.buf)
+    }
+}
+
+impl Deref for PooledBuf {
+    type Target = Vec<u8>;
+
+    fn deref(&self) -> &Vec<u8> {
+        &self.buf
+    }
+}
+
+impl DerefMut for PooledBuf {
+    fn deref_mut(&mut self) -> &mut Vec<u8> {
+        &mut self.buf
+    }
+}
+
+impl Drop for PooledBuf {
+    fn drop(&mut self) {
+        if self.buf.capacity() == 0 || self.buf.capacity() > MAX_RETAINED_CAPACITY {
+            return; // Nothing worth pooling, or too big to keep around
+        }
+        let mut free = free_list().lock().unwrap();
+        if free.len() < MAX_POOLED {
+            let mut buf = std::mem::take(&mut self.buf);
+            buf.clear();
+            free.push(buf);
+        }
+    }
+}
+
+/// Takes an empty buffer from the pool, allocating only when the pool is dry.
+pub fn acquire() -> PooledBuf {
+    let buf = free_list().lock().unwrap().pop().unwrap_or_default();
+    PooledBuf { buf }
+}
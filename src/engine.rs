@@ -0,0 +1,639 @@
+/// Event-driven connection engine for the MQTT broker.
+
+/*
+The default accept path in the server spawns one OS thread per TcpStream, which
+does not scale past a few thousand clients: each thread costs a stack and the
+kernel spends most of its time context switching between mostly idle readers.
+
+This module offers an alternative: a fixed pool of worker threads, each running
+an epoll readiness loop (through the mio crate) over non-blocking sockets, so a
+single worker can multiplex thousands of keep-alive connections that are idle
+most of the time. Writes are drained by a matching fixed WriterPool (see the
+outbound module) rather than a per-connection writer thread, so neither side
+of a connection costs a dedicated thread in this mode.
+*/
+
+use std::collections::HashMap;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::io::{ErrorKind, Read};
+use std::net::TcpStream as StdTcpStream;
+use std::sync::mpsc::{channel, Receiver, Sender};
+use std::sync::Arc;
+use std::thread;
+use std::time::Instant;
+
+use bytes::Bytes;
+use mio::net::TcpStream;
+use mio::{Events, Interest, Poll, Token, Waker};
+
+use crate::packets::{
+    connect::ConnectPacket,
+    connack::{ConnAckPacket, ConnAckReasonCode},
+    publish::{self, PublishPacket, PublishView},
+    puback::PubAckPacket,
+    subscribe::SubscribePacket,
+    suback::SubAckPacket,
+    ping::PingRespPacket,
+    disconnect::DisconnectPacket,
+};
+
+use crate::framing::PacketFramer;
+use crate::metrics;
+use crate::outbound::{Outbound, WriterPool};
+use crate::admission::admission;
+use crate::persist;
+use crate::retained::RetainedStore;
+use crate::session::{Session, SessionRegistry};
+use crate::timer::TimerWheel;
+use crate::subscriptions::filter_matches;
+use crate::subscriptions::SubscriptionTable;
+use crate::{log_debug, log_error, log_info};
+
+/// Token reserved for the waker that signals newly accepted connections.
+const WAKER_TOKEN: Token = Token(0);
+
+/// Shared subscription table, same one the threaded accept path uses.
+pub type TopicSubscriptions = Arc<SubscriptionTable>;
+
+/// State kept per multiplexed connection inside a worker.
+struct Connection {
+    stream: TcpStream,       // Non-blocking stream registered with the poll (read side)
+    outbound: Outbound,      // Write queue shared with the subscription lists
+    framer: PacketFramer,    // Reassembles whole packets from the byte stream
+    session: Option<Arc<Session>>, // Registered once a valid CONNECT arrives
+    topic_aliases: HashMap<u16, String>, // Inbound topic aliases (MQTT 5 property 0x23)
+    half_open: bool, // Still holds an admission slot until a valid CONNECT
+}
+
+/// A pool of event-loop workers; new sockets are handed out round-robin.
+pub struct EventEngine {
+    senders: Vec<Sender<StdTcpStream>>, // One channel per worker thread
+    wakers: Vec<Arc<Waker>>,            // Wakes the matching poll after a send
+    next_worker: AtomicUsize,           // Round-robin cursor over the workers
+}
+
+impl EventEngine {
+    /// Starts `workers` event-loop threads sharing the broker-wide state.
+    pub fn start(
+        workers: usize,
+        topic_subscriptions: TopicSubscriptions,
+        retained: Arc<RetainedStore>,
+        sessions: Arc<SessionRegistry>,
+        timers: Arc<TimerWheel>,
+    ) -> EventEngine {
+        let mut senders = Vec::new();
+        let mut wakers = Vec::new();
+
+        // One writer thread per event-loop worker; connections are pinned to
+        // a pool thread at accept time, so write-side thread count stays
+        // fixed no matter how many clients connect
+        let writer_pool = Arc::new(WriterPool::start(workers));
+
+        for worker_id in 0..workers {
+            let (sender, receiver) = channel();
+
+            let poll = Poll::new().expect("Error creating the poll instance");
+            let waker = Arc::new(
+                Waker::new(poll.registry(), WAKER_TOKEN).expect("Error creating the waker"),
+            );
+
+            let subscriptions_clone = Arc::clone(&topic_subscriptions);
+            let retained_clone = Arc::clone(&retained);
+            let sessions_clone = Arc::clone(&sessions);
+            let timers_clone = Arc::clone(&timers);
+            let writer_pool_clone = Arc::clone(&writer_pool);
+            thread::spawn(move || {
+                run_worker(
+                    worker_id,
+                    poll,
+                    receiver,
+                    subscriptions_clone,
+                    retained_clone,
+                    sessions_clone,
+                    timers_clone,
+                    writer_pool_clone,
+                );
+            });
+
+            senders.push(sender);
+            wakers.push(waker);
+        }
+
+        EventEngine {
+            senders,
+            wakers,
+            next_worker: AtomicUsize::new(0),
+        }
+    }
+
+    /// Hands an accepted socket to the next worker in round-robin order.
+    /// Takes &self (the cursor is atomic) so several listener threads can
+    /// dispatch into the same pool concurrently.
+    pub fn dispatch(&self, stream: StdTcpStream) {
+        let worker = self.next_worker.fetch_add(1, Ordering::Relaxed) % self.senders.len();
+
+        match self.senders[worker].send(stream) {
+            // Wake the worker's poll so it registers the new socket
+            Ok(_) => {
+                if let Err(e) = self.wakers[worker].wake() {
+                    log_error!("[-]Error waking worker {}: {}\n", worker, e);
+                }
+            }
+            Err(e) => {
+                // The socket is dropped with the send error; release the
+                // half-open slot it claimed at accept time
+                admission().settle();
+                log_error!("[-]Error dispatching connection to worker {}: {}\n", worker, e);
+            }
+        }
+    }
+}
+
+/// Body of one event-loop worker thread.
+fn run_worker(
+    worker_id: usize,
+    mut poll: Poll,
+    receiver: Receiver<StdTcpStream>,
+    topic_subscriptions: TopicSubscriptions,
+    retained: Arc<RetainedStore>,
+    sessions: Arc<SessionRegistry>,
+    timers: Arc<TimerWheel>,
+    writer_pool: Arc<WriterPool>,
+) {
+    let mut events = Events::with_capacity(1024);
+    let mut connections: HashMap<Token, Connection> = HashMap::new();
+    // Token 0 belongs to the waker, so connection tokens start at 1
+    let mut next_token = 1usize;
+
+    loop {
+        // Keep-alive deadlines belong to the timer wheel's housekeeping
+        // thread; an expired session's socket is shut down there, which shows
+        // up here as a readable event, so the poll can block indefinitely
+        if let Err(e) = poll.poll(&mut events, None) {
+            if e.kind() == ErrorKind::Interrupted {
+                continue;
+            }
+            log_error!("[-]Worker {} poll error: {}\n", worker_id, e);
+            break;
+        }
+
+        for event in events.iter() {
+            match event.token() {
+                WAKER_TOKEN => {
+                    // Register every socket the accept loop handed over
+                    while let Ok(stream) = receiver.try_recv() {
+                        register_connection(
+                            &mut poll,
+                            &mut connections,
+                            &mut next_token,
+                            stream,
+                            &writer_pool,
+                        );
+                    }
+                }
+                token => {
+                    if event.is_readable() {
+                        let closed = handle_readable(
+                            &mut connections,
+                            token,
+                            &topic_subscriptions,
+                            &retained,
+                            &sessions,
+                            &timers,
+                        );
+                        if closed {
+                            remove_connection(
+                                &mut poll,
+                                &mut connections,
+                                token,
+                                &sessions,
+                                &topic_subscriptions,
+                            );
+                        }
+                    }
+                }
+            }
+        }
+
+    }
+}
+
+/// Switches a freshly accepted socket to non-blocking mode and registers it.
+fn register_connection(
+    poll: &mut Poll,
+    connections: &mut HashMap<Token, Connection>,
+    next_token: &mut usize,
+    stream: StdTcpStream,
+    writer_pool: &WriterPool,
+) {
+    // The write side gets its own outbound queue, built on a plain clone of
+    // the socket before the read side is wrapped for the poll; the queue is
+    // drained by the shared writer pool, not a per-connection thread
+    // Every early return below drops a socket that claimed a half-open
+    // admission slot at accept time, so the slot must be handed back
+    let outbound = match stream.try_clone() {
+        Ok(clone) => writer_pool.attach(clone),
+        Err(e) => {
+            log_error!("[-]Error cloning accepted socket: {}\n", e);
+            admission().settle();
+            return;
+        }
+    };
+
+    if let Err(e) = stream.set_nonblocking(true) {
+        log_error!("[-]Error setting socket non-blocking: {}\n", e);
+        admission().settle();
+        return;
+    }
+
+    let mut mio_stream = TcpStream::from_std(stream);
+    let token = Token(*next_token);
+    *next_token += 1;
+
+    match poll
+        .registry()
+        .register(&mut mio_stream, token, Interest::READABLE)
+    {
+        Ok(_) => {
+            log_info!("[+]Client connected: {:?}\n", mio_stream.peer_addr());
+            connections.insert(
+                token,
+                Connection {
+                    stream: mio_stream,
+                    outbound,
+                    framer: PacketFramer::new(),
+                    session: None,
+                    topic_aliases: HashMap::new(),
+                    half_open: true,
+                },
+            );
+        }
+        Err(e) => {
+            log_error!("[-]Error registering connection: {}\n", e);
+            outbound.shutdown();
+            admission().settle();
+        }
+    }
+}
+
+/// Deregisters a connection from the poll and drops its state.
+fn remove_connection(
+    poll: &mut Poll,
+    connections: &mut HashMap<Token, Connection>,
+    token: Token,
+    sessions: &SessionRegistry,
+    topic_subscriptions: &SubscriptionTable,
+) {
+    if let Some(mut conn) = connections.remove(&token) {
+        let _ = poll.registry().deregister(&mut conn.stream);
+        conn.outbound.shutdown(); // Let the writer thread drain and exit
+        // A connection that never produced a valid CONNECT still holds its
+        // half-open admission slot; release it on the way out
+        if conn.half_open {
+            admission().settle();
+        }
+        // Unregister the session in O(1) and unlink it from every topic list
+        // it subscribed to. The removal is conditional on identity: after a
+        // takeover the registry holds the NEW session under this client ID,
+        // which must stay registered
+        if let Some(session) = conn.session.take() {
+            session.unsubscribe_all(topic_subscriptions);
+            sessions.remove_if_current(&session);
+        }
+        log_info!("[+]Client disconnected: {:?}\n", conn.stream.peer_addr());
+    }
+}
+
+/// Drains readable data from one connection. Returns true once it should close.
+fn handle_readable(
+    connections: &mut HashMap<Token, Connection>,
+    token: Token,
+    topic_subscriptions: &TopicSubscriptions,
+    retained: &RetainedStore,
+    sessions: &SessionRegistry,
+    timers: &TimerWheel,
+) -> bool {
+    let mut buffer = [0u8; 4096];
+
+    loop {
+        let conn = match connections.get_mut(&token) {
+            Some(conn) => conn,
+            None => return false,
+        };
+
+        match conn.stream.read(&mut buffer) {
+            Ok(0) => return true, // Peer closed the connection
+            Ok(size) => {
+                metrics::add(&metrics::metrics().bytes_in, size as u64);
+
+                // Buffer the bytes and process every complete packet; a
+                // partial packet stays in the framer until the rest arrives
+                conn.framer.extend(&buffer[..size]);
+                loop {
+                    match conn.framer.next_frame() {
+                        Ok(Some(frame)) => {
+                            if process_packet(conn, &frame, topic_subscriptions, retained, sessions, timers) {
+                                return true;
+                            }
+                        }
+                        Ok(None) => break, // No complete packet buffered yet
+                        Err(e) => {
+                            log_error!("[-]Malformed packet from client: {}\n", e);
+                            return true;
+                        }
+                    }
+                }
+            }
+            // No more data ready on this socket for now
+            Err(e) if e.kind() == ErrorKind::WouldBlock => return false,
+            Err(e) if e.kind() == ErrorKind::Interrupted => continue,
+            Err(e) => {
+                log_error!("[-]Error reading from stream: {}\n", e);
+                return true;
+            }
+        }
+    }
+}
+
+/// Dispatches one inbound packet, mirroring the threaded handle_client logic.
+/// Returns true when the connection should be closed.
+fn process_packet(
+    conn: &mut Connection,
+    data: &[u8],
+    topic_subscriptions: &TopicSubscriptions,
+    retained: &RetainedStore,
+    sessions: &SessionRegistry,
+    timers: &TimerWheel,
+) -> bool {
+    // The first packet on a connection must be CONNECT
+    if conn.session.is_none() {
+        match ConnectPacket::decode(data) {
+            Ok(connect_packet) => {
+                log_info!("[+]Received CONNECT packet: {:?}\n", connect_packet);
+
+                let connack_packet =
+                    ConnAckPacket::new(false, ConnAckReasonCode::Success, None);
+                let response = connack_packet.encode();
+
+                if conn.outbound.send(Bytes::from(response)) {
+                    log_info!("[+]Sent CONNACK package: {:?}\n", connack_packet);
+                } else {
+                    log_error!("[-]Error sending the CONNACK package: connection closed\n");
+                }
+
+                // Register the session under its client ID (O(1)); a previous
+                // session with the same ID is taken over
+                let session = Arc::new(Session::new(
+                    connect_packet.client_id.clone(),
+                    conn.outbound.clone(),
+                    connect_packet.keep_alive,
+                ));
+                if let Some(old) = sessions.insert(Arc::clone(&session)) {
+                    log_info!("[+]Session taken over for client: {}\n", old.client_id);
+                    old.outbound.shutdown();
+                    old.unsubscribe_all(topic_subscriptions);
+                }
+                // Keep-alive enforcement is handed to the timer wheel
+                timers.schedule(&session);
+                conn.session = Some(session);
+                metrics::count(&metrics::metrics().connects);
+
+                // A valid CONNECT arrived: release the half-open slot
+                if conn.half_open {
+                    admission().settle();
+                    conn.half_open = false;
+                }
+
+                // Clean Session (flag 0x02) wipes the stored state; otherwise
+                // the client's persisted filters are re-linked right here, no
+                // re-SUBSCRIBE round trips needed
+                if connect_packet.connect_flags & 0x02 != 0 {
+                    persist::store().clear(&connect_packet.client_id);
+                } else {
+                    let saved = persist::store().saved_filters(&connect_packet.client_id);
+                    if !saved.is_empty() {
+                        log_info!(
+                            "[+]Restoring {} subscriptions for client: {}\n",
+                            saved.len(),
+                            connect_packet.client_id
+                        );
+                    }
+                    if let Some(ref session) = conn.session {
+                        for filter in saved {
+                            topic_subscriptions.subscribe(&filter, conn.outbound.clone());
+                            session.add_subscription(&filter);
+                        }
+                    }
+                }
+            }
+            Err(e) => log_error!("[-]Error decoding CONNECT: {}\n", e),
+        }
+        return false;
+    }
+
+    // Any inbound packet proves the client is alive; the timer wheel reads
+    // this timestamp when the session's deadline comes due
+    if let Some(ref session) = conn.session {
+        session.touch();
+    }
+
+    // MQTT packet type is in the top 4 bits of the first byte
+    let packet_type = data[0] >> 4;
+
+    match packet_type {
+        3 => {
+            // PUBLISH packet: only the header is parsed; topic and payload
+            // stay borrowed from the frame
+            let decode_start = Instant::now();
+            if let Ok(packet) = PublishView::parse(data) {
+                log_debug!("[+]Received PUBLISH packet: {:?}\n", packet);
+                metrics::count(&metrics::metrics().publishes_in);
+
+                // Resolve the topic through this connection's alias table: a
+                // full topic registers its alias, an empty topic reuses the
+                // remembered one
+                let topic = match publish::resolve_topic_alias(
+                    packet.topic_name,
+                    packet.topic_alias,
+                    &mut conn.topic_aliases,
+                ) {
+                    Some(topic) => topic,
+                    None => {
+                        log_error!("[-]PUBLISH with unknown topic alias; dropping\n");
+                        return false;
+                    }
+                };
+
+                // Send PUBACK packet back to the sender
+                let puback_packet = PubAckPacket::new(packet.message_id);
+                let puback_response = puback_packet.encode();
+                if conn.outbound.send(Bytes::from(puback_response)) {
+                    log_debug!(
+                        "[+]Sent PUBACK packet for message ID: {}\n",
+                        packet.message_id
+                    );
+                } else {
+                    log_error!("[-]Error sending PUBACK packet: connection closed\n");
+                }
+
+                // The broker forwards the PUBLISH unmodified, so the inbound
+                // wire bytes are captured once in a shared buffer instead of
+                // re-encoding per subscriber. An aliased frame is re-expanded
+                // first, because subscribers do not share this table
+                let publish_response = if packet.topic_name.is_empty() {
+                    Bytes::from(
+                        PublishPacket::new(
+                            topic.to_string(),
+                            packet.message_id,
+                            packet.qos,
+                            packet.retain,
+                            packet.dup,
+                            packet.payload.to_vec(),
+                        )
+                        .encode(),
+                    )
+                } else {
+                    Bytes::copy_from_slice(data)
+                };
+
+                // Remember (or clear) the retained message so new subscribers
+                // get the last known value immediately
+                if packet.retain {
+                    if packet.payload.is_empty() {
+                        retained.clear(topic);
+                    } else {
+                        retained.store(topic, publish_response.clone());
+                    }
+                }
+
+                // Fan the message out under the shard's read lock
+                let mut saw_dead = false;
+                let had_subscribers = topic_subscriptions
+                    .for_each_subscriber(topic, |subscriber| {
+                        // Numeric ID compare: no syscalls in the fan-out loop
+                        if subscriber.id() != conn.outbound.id() {
+                            // Enqueue only: the subscriber's writer thread
+                            // performs the network write. QoS 1 deliveries get
+                            // a message ID from the subscriber's window
+                            // The Message Expiry Interval rides along so a
+                            // queued frame can expire while waiting
+                            let delivered = if packet.qos > 0 {
+                                subscriber.send_qos1(&publish_response, packet.message_expiry)
+                            } else {
+                                subscriber.send_expiring(publish_response.clone(), packet.message_expiry)
+                            };
+                            if delivered {
+                                metrics::count(&metrics::metrics().publishes_out);
+                                log_debug!(
+                                    "[+]Sent PUBLISH packet to subscriber: {:?}\n",
+                                    subscriber.peer_addr()
+                                );
+                            } else {
+                                metrics::count(&metrics::metrics().dropped_writes);
+                                log_debug!("[-]Subscriber unavailable; dropping PUBLISH\n");
+                                saw_dead |= subscriber.is_dead();
+                            }
+                        }
+                    });
+                // Lazy eviction: a failed delivery to a dead connection
+                // triggers a sweep of this topic's shard
+                if saw_dead {
+                    topic_subscriptions.evict_dead(topic);
+                }
+                if had_subscribers {
+                    log_debug!("Message sent to topic: {}\n", topic);
+                } else {
+                    log_debug!("No subscribers for topic: {}\n", topic);
+                }
+
+                // Decode-to-fan-out time for this PUBLISH
+                metrics::metrics()
+                    .fanout_latency
+                    .record_us(decode_start.elapsed().as_micros() as u64);
+            }
+        }
+
+        8 => {
+            // SUBSCRIBE packet
+            if let Ok(packet) = SubscribePacket::decode(data) {
+                log_debug!("[+]Received SUBSCRIBE packet: {:?}\n", packet);
+
+                let return_codes: Vec<u8> = packet
+                    .qos_values
+                    .iter()
+                    .map(|&qos| if qos <= 2 { qos } else { 0x80 })
+                    .collect();
+
+                let suback_packet = SubAckPacket {
+                    packet_id: packet.packet_id,
+                    return_codes,
+                };
+
+                let suback_response = suback_packet.encode();
+                if conn.outbound.send(Bytes::from(suback_response.clone())) {
+                    log_debug!("[+]Sent SUBACK : {:?}\n", suback_response);
+                } else {
+                    log_error!("[-]Error sending SUBACK packet: connection closed\n");
+                }
+
+                // Add the connection's outbound queue to the topic subscriptions
+                for topic in packet.topic_filters.iter() {
+                    topic_subscriptions.subscribe(topic, conn.outbound.clone());
+                    if let Some(ref session) = conn.session {
+                        session.add_subscription(topic);
+                        // Durable: survives a broker restart
+                        persist::store().record_subscribe(&session.client_id, topic);
+                    }
+                    log_info!("A client added to topic list: {}\n", topic);
+                }
+
+                // Deliver retained messages matching the new filters from a
+                // lock-free snapshot of the store
+                let snapshot = retained.snapshot();
+                for (topic, frame) in snapshot.iter() {
+                    let wanted = packet
+                        .topic_filters
+                        .iter()
+                        .any(|filter| filter_matches(filter, topic));
+                    if wanted && conn.outbound.send(frame.clone()) {
+                        log_debug!("[+]Sent retained message for topic: {}\n", topic);
+                    }
+                }
+            }
+        }
+
+        4 => {
+            // PUBACK from the client for a QoS 1 message the broker
+            // delivered: release its inflight slot
+            if let Ok(packet) = PubAckPacket::decode(data) {
+                if conn.outbound.acknowledge(packet.packet_id) {
+                    log_debug!("[+]PUBACK received for message ID: {}\n", packet.packet_id);
+                } else {
+                    log_debug!("[-]PUBACK for unknown message ID: {}\n", packet.packet_id);
+                }
+            }
+        }
+
+        12 => {
+            // Valid PINGREQ packet received; respond with PINGRESP
+            let pingresp_packet = PingRespPacket;
+            let pingresp_response = pingresp_packet.encode();
+            if !conn.outbound.send(pingresp_response.freeze()) {
+                log_error!("[-]Error sending PINGRESP packet: connection closed\n");
+            }
+        }
+
+        14 => {
+            if let Ok(packet) = DisconnectPacket::decode(data) {
+                log_debug!("[+]Received DISCONNECT packet: {:?}\n", packet);
+                return true;
+            }
+        }
+
+        _ => {
+            log_debug!("[-]Unknown or unsupported packet type: {}\n", packet_type);
+        }
+    }
+
+    false
+}
@@ -0,0 +1,103 @@
+/// Streaming packet framer for the MQTT broker.
+
+/*
+Reading with a single stream.read() into a fixed array and assuming exactly one
+whole packet arrived is wrong twice over: a payload larger than the array gets
+truncated, and TCP coalescing can deliver two packets in one read so the second
+one parses as garbage. It is also slow, since every packet costs one syscall.
+
+The framer accumulates whatever the socket delivers, uses the Remaining Length
+varint from the MQTT fixed header to find exact packet boundaries, and hands
+out one complete frame at a time for the decode() functions in src/packets/.
+A large read can thus carry many packets (one syscall amortized over all of
+them), and a packet split across reads is reassembled transparently. Frames
+are handed out in pooled buffers, so the per-packet copy reuses a recycled
+allocation instead of a fresh Vec.
+*/
+
+use crate::bufpool::{self, PooledBuf};
+
+/// Accumulates raw socket bytes and splits them into complete MQTT packets.
+pub struct PacketFramer {
+    buffer: Vec<u8>, // Bytes received but not yet returned as frames
+    consumed: usize, // Prefix of `buffer` already handed out as frames
+}
+
+impl PacketFramer {
+    /// Creates an empty framer.
+    pub fn new() -> Self {
+        PacketFramer {
+            buffer: Vec::new(),
+            consumed: 0,
+        }
+    }
+
+    /// Appends freshly read socket bytes to the pending buffer.
+    pub fn extend(&mut self, data: &[u8]) {
+        // Drop the already-consumed prefix before growing the buffer so it
+        // does not expand without bound on a long-lived connection
+        if self.consumed > 0 {
+            self.buffer.drain(..self.consumed);
+            self.consumed = 0;
+        }
+        self.buffer.extend_from_slice(data);
+    }
+
+    /// Returns the next complete packet frame, or None until enough bytes
+    /// have arrived. Malformed length headers produce an error so the caller
+    /// can drop the connection.
+    pub fn next_frame(&mut self) -> Result<Option<PooledBuf>, String> {
+        let pending = &self.buffer[self.consumed..];
+
+        match frame_length(pending)? {
+            Some(frame_len) => {
+                // Copy into a pooled buffer; the allocation is recycled once
+                // the caller drops the frame
+                let mut frame = bufpool::acquire();
+                frame.extend_from_slice(&pending[..frame_len]);
+                self.consumed += frame_len;
+                Ok(Some(frame))
+            }
+            None => Ok(None),
+        }
+    }
+}
+
+/// Computes the total length (fixed header + Remaining Length payload) of the
+/// packet at the start of `data`, or None when not enough bytes are buffered.
+fn frame_length(data: &[u8]) -> Result<Option<usize>, String> {
+    // Need at least the packet-type byte and one length byte
+    if data.len() < 2 {
+        return Ok(None);
+    }
+
+    // Decode the Remaining Length varint (1 to 4 bytes after the first byte)
+    let mut remaining_length = 0usize;
+    let mut multiplier = 1usize;
+    let mut header_len = 1; // The packet-type byte
+
+    loop {
+        if header_len >= data.len() {
+            return Ok(None); // The varint itself is still incomplete
+        }
+        if header_len > 4 {
+            return Err("Malformed Remaining Length: more than 4 bytes".to_string());
+        }
+
+        let byte = data[header_len];
+        header_len += 1;
+        remaining_length += (byte & 0x7F) as usize * multiplier;
+        multiplier *= 128;
+
+        if (byte & 0x80) == 0 {
+            break;
+        }
+    }
+
+    let total = header_len + remaining_length;
+    if data.len() < total {
+        Ok(None) // The body has not fully arrived yet
+    } else {
+        Ok(Some(total))
+    }
+}
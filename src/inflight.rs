@@ -0,0 +1,165 @@
+/// QoS 1 inflight window backed by a preallocated message-ID slab.
+
+/*
+The broker used to acknowledge QoS 1 publishes and forget them, and the client
+hardcoded message ID 1, so redelivery was impossible and acknowledgments were
+meaningless. Real QoS 1 needs every unacknowledged message tracked until its
+PUBACK arrives.
+
+The window is a fixed-size slab of slots indexed by the 16-bit message ID
+(id modulo the window size), so allocating an ID, matching a PUBACK, and
+releasing a slot are all array indexing rather than map lookups, and the
+retransmit scan walks one contiguous region of memory.
+*/
+
+use std::time::{Duration, Instant};
+
+use bytes::Bytes;
+
+/// Number of slots in the slab; messages beyond this are back-pressured.
+const WINDOW_SIZE: usize = 1024;
+
+/// How long a message may sit unacknowledged before it is resent.
+const RETRANSMIT_AFTER: Duration = Duration::from_secs(5);
+
+/// One tracked QoS 1 message awaiting its PUBACK.
+struct Slot {
+    message_id: u16,  // Full ID, to detect stale slot reuse
+    frame: Bytes,     // Encoded PUBLISH frame for retransmission
+    sent_at: Instant, // Last (re)transmission time
+}
+
+/// Fixed-size inflight window; one per session.
+pub struct InflightWindow {
+    slots: Vec<Option<Slot>>, // Preallocated slab, indexed by id % WINDOW_SIZE
+    next_id: u16,             // Next candidate message ID (1..=65535)
+    in_use: usize,            // Occupied slot count
+}
+
+impl InflightWindow {
+    /// Creates an empty window with all slots preallocated.
+    pub fn new() -> Self {
+        let mut slots = Vec::with_capacity(WINDOW_SIZE);
+        for _ in 0..WINDOW_SIZE {
+            slots.push(None);
+        }
+        InflightWindow {
+            slots,
+            next_id: 1,
+            in_use: 0,
+        }
+    }
+
+    /// Reserves a free message ID, or None when the window is full (the
+    /// caller decides whether to drop or wait).
+    pub fn reserve(&mut self) -> Option<u16> {
+        if self.in_use >= WINDOW_SIZE {
+            return None;
+        }
+
+        // The window is not full, so some slot in the slab must be free
+        loop {
+            let id = self.next_id;
+            // Message IDs are 1..=65535; zero is forbidden by MQTT
+            self.next_id = if self.next_id == u16::MAX { 1 } else { self.next_id + 1 };
+
+            let index = id as usize % WINDOW_SIZE;
+            if self.slots[index].is_none() {
+                self.slots[index] = Some(Slot {
+                    message_id: id,
+                    frame: Bytes::new(),
+                    sent_at: Instant::now(),
+                });
+                self.in_use += 1;
+                return Some(id);
+            }
+        }
+    }
+
+    /// Stores the encoded frame for a reserved ID so it can be resent.
+    pub fn track(&mut self, message_id: u16, frame: Bytes) {
+        let index = message_id as usize % WINDOW_SIZE;
+        if let Some(slot) = self.slots[index].as_mut() {
+            if slot.message_id == message_id {
+                slot.frame = frame;
+                slot.sent_at = Instant::now();
+            }
+        }
+    }
+
+    /// Releases the slot for an acknowledged message: a single array index,
+    /// no map lookup. Returns false for unknown or already-acked IDs.
+    pub fn acknowledge(&mut self, message_id: u16) -> bool {
+        let index = message_id as usize % WINDOW_SIZE;
+        match self.slots[index].as_ref() {
+            Some(slot) if slot.message_id == message_id => {
+                self.slots[index] = None;
+                self.in_use -= 1;
+                true
+            }
+            _ => false,
+        }
+    }
+
+    /// Scans the slab for messages past the retransmit deadline, refreshing
+    /// their timers and returning copies with the DUP flag set.
+    pub fn stale_frames(&mut self) -> Vec<Bytes> {
+        let mut stale = Vec::new();
+
+        if self.in_use == 0 {
+            return stale;
+        }
+
+        for slot in self.slots.iter_mut().flatten() {
+            if slot.sent_at.elapsed() > RETRANSMIT_AFTER && !slot.frame.is_empty() {
+                let mut frame = slot.frame.to_vec();
+                frame[0] |= 0x08; // DUP flag: this is a redelivery
+                slot.sent_at = Instant::now();
+                stale.push(Bytes::from(frame));
+            }
+        }
+
+        stale
+    }
+
+    /// Number of messages currently awaiting acknowledgment.
+    pub fn len(&self) -> usize {
+        self.in_use
+    }
+}
+
+/// Rewrites the Variable Header message ID of an encoded QoS 1/2 PUBLISH
+/// frame, returning the new frame. Returns None for QoS 0 or malformed input.
+pub fn rewrite_message_id(frame: &[u8], message_id: u16) -> Option<Vec<u8>> {
+    if frame.is_empty() || (frame[0] >> 4) != 3 {
+        return None;
+    }
+
+    // Only QoS 1 and 2 publishes carry a message ID
+    let qos = (frame[0] >> 1) & 0x03;
+    if qos == 0 {
+        return None;
+    }
+
+    // Skip the Remaining Length varint (1 to 4 bytes)
+    let mut index = 1;
+    while index < frame.len() && frame[index] & 0x80 != 0 {
+        index += 1;
+    }
+    index += 1;
+
+    // Topic length (2 bytes) followed by the topic itself
+    if index + 2 > frame.len() {
+        return None;
+    }
+    let topic_len = ((frame[index] as usize) << 8) | frame[index + 1] as usize;
+    let id_pos = index + 2 + topic_len;
+    if id_pos + 2 > frame.len() {
+        return None;
+    }
+
+    let mut rewritten = frame.to_vec();
+    rewritten[id_pos] = (message_id >> 8) as u8;
+    rewritten[id_pos + 1] = message_id as u8;
+    Some(rewritten)
+}
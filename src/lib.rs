@@ -1,6 +1,48 @@
 // Import all the packets from their modules
 pub mod packets;
 
+// Event-driven connection engine (epoll worker pool)
+pub mod engine;
+
+// Sharded subscription table shared by both accept paths
+pub mod subscriptions;
+
+// Buffered framing layer that splits the byte stream into whole packets
+pub mod framing;
+
+// Per-connection outbound write queues flushed with vectored I/O
+pub mod outbound;
+
+// Leveled logging with an in-memory ring buffer drained off the hot path
+pub mod logging;
+
+// Retained-message store with copy-on-write snapshots
+pub mod retained;
+
+// QoS 1 inflight tracking with a preallocated message-ID slab
+pub mod inflight;
+
+// Session registry keyed by client ID
+pub mod session;
+
+// Hashed timer wheel enforcing keep-alive deadlines
+pub mod timer;
+
+// Reusable byte-buffer pool for the packet hot path
+pub mod bufpool;
+
+// Atomic counters and latency histograms published on $SYS
+pub mod metrics;
+
+// Accept-time admission control: per-IP token buckets and a half-open cap
+pub mod admission;
+
+// Durable session storage: append-only log with compaction and replay
+pub mod persist;
+
+// Inter-broker bridge link with batched forwarding
+pub mod bridge;
+
 pub use packets::{
     connect::ConnectPacket,
     connack::ConnAckPacket,
@@ -0,0 +1,135 @@
+/// Asynchronous, leveled logging facility for the MQTT broker.
+
+/*
+The broker used to println! several lines per packet, including full payload
+Debug dumps. stdout writes are synchronous and serialized across threads, so
+under load the logging alone capped throughput at a few thousand messages per
+second.
+
+Log records are now formatted only when their level is enabled and pushed into
+an in-memory ring buffer; a background thread drains the buffer to stdout in
+batches, so the hot path never blocks on the terminal. When the ring is full
+the record is dropped and counted instead of stalling the caller. Per-packet
+records (including payload dumps) log at DEBUG, which is off by default; set
+the MQTT_LOG environment variable to "debug", "info" or "error" to change the
+level.
+*/
+
+use std::collections::VecDeque;
+use std::io::Write;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Mutex, OnceLock};
+use std::thread;
+use std::time::Duration;
+
+/// Log levels in increasing verbosity.
+pub const LEVEL_ERROR: u8 = 0;
+pub const LEVEL_INFO: u8 = 1;
+pub const LEVEL_DEBUG: u8 = 2;
+
+/// Records buffered before writers start dropping instead of blocking.
+const RING_CAPACITY: usize = 8192;
+
+/// Interval at which the background thread drains the ring to stdout.
+const DRAIN_INTERVAL: Duration = Duration::from_millis(50);
+
+struct Logger {
+    level: u8,                  // Maximum enabled level
+    ring: Mutex<VecDeque<String>>, // Pending records awaiting the drain thread
+    dropped: AtomicU64,         // Records discarded because the ring was full
+}
+
+static LOGGER: OnceLock<Logger> = OnceLock::new();
+
+/// Returns the global logger, initializing it (and its drain thread) once.
+fn logger() -> &'static Logger {
+    LOGGER.get_or_init(|| {
+        // INFO keeps connection lifecycle visible without per-packet noise
+        let level = match std::env::var("MQTT_LOG").as_deref() {
+            Ok("debug") => LEVEL_DEBUG,
+            Ok("error") => LEVEL_ERROR,
+            _ => LEVEL_INFO,
+        };
+
+        thread::spawn(drain_loop);
+
+        Logger {
+            level,
+            ring: Mutex::new(VecDeque::with_capacity(RING_CAPACITY)),
+            dropped: AtomicU64::new(0),
+        }
+    })
+}
+
+/// Whether records of the given level are currently enabled. The logging
+/// macros check this before formatting, so disabled records cost nothing.
+pub fn enabled(level: u8) -> bool {
+    level <= logger().level
+}
+
+/// Pushes a formatted record into the ring, dropping it when the ring is full.
+pub fn log(line: String) {
+    let instance = logger();
+    let mut ring = instance.ring.lock().unwrap();
+    if ring.len() >= RING_CAPACITY {
+        instance.dropped.fetch_add(1, Ordering::Relaxed);
+    } else {
+        ring.push_back(line);
+    }
+}
+
+/// Body of the background drain thread: batches the ring out to stdout.
+fn drain_loop() {
+    loop {
+        thread::sleep(DRAIN_INTERVAL);
+
+        let instance = logger();
+        let batch: VecDeque<String> = {
+            let mut ring = instance.ring.lock().unwrap();
+            std::mem::take(&mut *ring)
+        };
+        let dropped = instance.dropped.swap(0, Ordering::Relaxed);
+
+        if batch.is_empty() && dropped == 0 {
+            continue;
+        }
+
+        // One locked stdout write per batch instead of one per record
+        let stdout = std::io::stdout();
+        let mut handle = stdout.lock();
+        for line in batch {
+            let _ = writeln!(handle, "{}", line);
+        }
+        if dropped > 0 {
+            let _ = writeln!(handle, "[-]{} log records dropped (ring buffer full)", dropped);
+        }
+    }
+}
+
+/// Logs an error record (always enabled).
+#[macro_export]
+macro_rules! log_error {
+    ($($arg:tt)*) => {
+        $crate::logging::log(format!($($arg)*))
+    };
+}
+
+/// Logs a connection-lifecycle record (enabled by default).
+#[macro_export]
+macro_rules! log_info {
+    ($($arg:tt)*) => {
+        if $crate::logging::enabled($crate::logging::LEVEL_INFO) {
+            $crate::logging::log(format!($($arg)*));
+        }
+    };
+}
+
+/// Logs a per-packet record (off by default; enable with MQTT_LOG=debug).
+#[macro_export]
+macro_rules! log_debug {
+    ($($arg:tt)*) => {
+        if $crate::logging::enabled($crate::logging::LEVEL_DEBUG) {
+            $crate::logging::log(format!($($arg)*));
+        }
+    };
+}
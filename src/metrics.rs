@@ -0,0 +1,167 @@
+/// Broker-side metrics: atomic counters and fixed-bucket latency histograms.
+
+/*
+The broker could only be measured from the outside, by timing client round
+trips, which says nothing about where time goes internally or how much work
+the broker is actually doing. This module keeps first-class counters
+(connects, publishes in/out, bytes in/out, dropped writes) and a histogram of
+the decode-to-fan-out time of each PUBLISH.
+
+Everything is updated with relaxed atomics, so instrumenting the hot path
+costs one uncontended memory operation per event — no locks, no allocation.
+A reporter thread publishes a plain-text snapshot to the $SYS/broker/metrics
+topic every few seconds, so any MQTT client can watch the broker with a
+normal subscription.
+*/
+
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::Arc;
+use std::thread;
+use std::time::Duration;
+
+use bytes::Bytes;
+
+use crate::packets::publish::PublishPacket;
+use crate::subscriptions::SubscriptionTable;
+
+/// Topic the reporter publishes snapshots to.
+const SYS_TOPIC: &str = "$SYS/broker/metrics";
+
+/// How often the reporter publishes a snapshot.
+const REPORT_INTERVAL: Duration = Duration::from_secs(10);
+
+/// Upper bounds (in microseconds) of the histogram buckets; the last bucket
+/// is open-ended.
+const BUCKET_BOUNDS_US: [u64; 8] = [10, 50, 100, 500, 1_000, 5_000, 10_000, 50_000];
+
+/// Fixed-bucket histogram updated with relaxed atomics.
+pub struct Histogram {
+    buckets: [AtomicU64; BUCKET_BOUNDS_US.len() + 1],
+}
+
+impl Histogram {
+    const fn new() -> Self {
+        const ZERO: AtomicU64 = AtomicU64::new(0);
+        Histogram {
+            buckets: [ZERO; BUCKET_BOUNDS_US.len() + 1],
+        }
+    }
+
+    /// Records one sample, in microseconds.
+    pub fn record_us(&self, micros: u64) {
+        let mut index = BUCKET_BOUNDS_US.len();
+        for (i, bound) in BUCKET_BOUNDS_US.iter().enumerate() {
+            if micros <= *bound {
+                index = i;
+                break;
+            }
+        }
+        self.buckets[index].fetch_add(1, Ordering::Relaxed);
+    }
+
+    /// Appends one "le_<bound> <count>" line per bucket to the report.
+    fn write_report(&self, name: &str, out: &mut String) {
+        for (i, bound) in BUCKET_BOUNDS_US.iter().enumerate() {
+            let count = self.buckets[i].load(Ordering::Relaxed);
+            out.push_str(&format!("{}_le_{}us {}\n", name, bound, count));
+        }
+        let overflow = self.buckets[BUCKET_BOUNDS_US.len()].load(Ordering::Relaxed);
+        out.push_str(&format!("{}_overflow {}\n", name, overflow));
+    }
+}
+
+/// All broker counters; one process-wide instance behind metrics().
+pub struct Metrics {
+    pub connects: AtomicU64,       // CONNECT packets accepted
+    pub publishes_in: AtomicU64,   // PUBLISH packets received
+    pub publishes_out: AtomicU64,  // PUBLISH deliveries enqueued to subscribers
+    pub bytes_in: AtomicU64,       // Raw bytes read from client sockets
+    pub bytes_out: AtomicU64,      // Raw bytes written to client sockets
+    pub dropped_writes: AtomicU64, // Deliveries refused (dead or full queue)
+    pub expired_messages: AtomicU64, // Frames dropped past their expiry interval
+    pub fanout_latency: Histogram, // PUBLISH decode-to-fan-out time
+}
+
+impl Metrics {
+    const fn new() -> Self {
+        Metrics {
+            connects: AtomicU64::new(0),
+            publishes_in: AtomicU64::new(0),
+            publishes_out: AtomicU64::new(0),
+            bytes_in: AtomicU64::new(0),
+            bytes_out: AtomicU64::new(0),
+            dropped_writes: AtomicU64::new(0),
+            expired_messages: AtomicU64::new(0),
+            fanout_latency: Histogram::new(),
+        }
+    }
+
+    /// Renders every counter and histogram as one text line each.
+    pub fn report(&self) -> String {
+        let mut out = String::new();
+        out.push_str(&format!(
+            "connects {}\n",
+            self.connects.load(Ordering::Relaxed)
+        ));
+        out.push_str(&format!(
+            "publishes_in {}\n",
+            self.publishes_in.load(Ordering::Relaxed)
+        ));
+        out.push_str(&format!(
+            "publishes_out {}\n",
+            self.publishes_out.load(Ordering::Relaxed)
+        ));
+        out.push_str(&format!(
+            "bytes_in {}\n",
+            self.bytes_in.load(Ordering::Relaxed)
+        ));
+        out.push_str(&format!(
+            "bytes_out {}\n",
+            self.bytes_out.load(Ordering::Relaxed)
+        ));
+        out.push_str(&format!(
+            "dropped_writes {}\n",
+            self.dropped_writes.load(Ordering::Relaxed)
+        ));
+        out.push_str(&format!(
+            "expired_messages {}\n",
+            self.expired_messages.load(Ordering::Relaxed)
+        ));
+        self.fanout_latency.write_report("fanout_latency", &mut out);
+        out
+    }
+}
+
+static METRICS: Metrics = Metrics::new();
+
+/// The process-wide metrics instance.
+pub fn metrics() -> &'static Metrics {
+    &METRICS
+}
+
+/// Convenience for the counters: one relaxed increment.
+pub fn count(counter: &AtomicU64) {
+    counter.fetch_add(1, Ordering::Relaxed);
+}
+
+/// Convenience for the byte counters: one relaxed add.
+pub fn add(counter: &AtomicU64, amount: u64) {
+    counter.fetch_add(amount, Ordering::Relaxed);
+}
+
+/// Spawns the reporter thread that publishes a snapshot of every counter to
+/// $SYS/broker/metrics on a fixed interval, through the normal fan-out path.
+pub fn start_reporter(topic_subscriptions: Arc<SubscriptionTable>) {
+    thread::spawn(move || loop {
+        thread::sleep(REPORT_INTERVAL);
+
+        let report = metrics().report();
+        let packet =
+            PublishPacket::new(SYS_TOPIC.to_string(), 0, 0, false, false, report.into_bytes());
+        let frame = Bytes::from(packet.encode());
+
+        topic_subscriptions.for_each_subscriber(SYS_TOPIC, |subscriber| {
+            subscriber.send(frame.clone());
+        });
+    });
+}
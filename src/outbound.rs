@@ -0,0 +1,608 @@
+/// Per-connection outbound write queue with vectored flushing.
+
+/*
+Every outbound packet used to be its own blocking stream.write() syscall, and a
+slow subscriber stalled the publisher's thread for the whole fan-out loop.
+
+Each connection now owns an Outbound handle: callers enqueue encoded packets
+(cheap, never touches the network) and a dedicated writer thread drains the
+queue with write_vectored, so a burst of messages to the same subscriber
+becomes a single writev syscall and the publish path never blocks on a peer.
+*/
+
+use std::collections::VecDeque;
+use std::io::{ErrorKind, IoSlice, Write};
+use std::net::{Shutdown, SocketAddr, TcpStream};
+use std::sync::atomic::{AtomicBool, AtomicU64, AtomicUsize, Ordering};
+use std::sync::{Arc, Condvar, Mutex, OnceLock};
+use std::thread;
+use std::time::{Duration, Instant};
+
+use bytes::{Buf, Bytes};
+
+use crate::inflight::{rewrite_message_id, InflightWindow};
+use crate::metrics;
+use crate::packets::disconnect::{DisconnectPacket, DisconnectReasonCode};
+use crate::{log_error, log_info};
+
+/// Upper bound on buffers handed to one write_vectored call
+/// (comfortably below the kernel's IOV_MAX of 1024).
+const MAX_BATCH: usize = 64;
+
+/// Source of unique connection IDs; never reused for the process lifetime.
+static NEXT_CONNECTION_ID: AtomicU64 = AtomicU64::new(1);
+
+/// Upper bound on frames queued for one connection; beyond this the oldest
+/// frame is dropped (the subscriber is too slow to keep them all anyway).
+const MAX_QUEUED: usize = 1024;
+
+/// Overflow events tolerated before the connection is treated as a chronic
+/// slow consumer and disconnected. The count resets whenever the writer
+/// fully drains the queue, so a one-off burst is forgiven.
+const MAX_OVERFLOWS: u32 = 8;
+
+/// Default per-connection byte budget for queued frames. The frame-count cap
+/// alone lets a publisher of large payloads pin ~64 MB per slow subscriber;
+/// the byte budget bounds it regardless of frame size.
+const DEFAULT_MAX_QUEUED_BYTES: usize = 4 * 1024 * 1024;
+
+/// The per-connection byte budget, overridable through the
+/// MQTT_MAX_QUEUED_BYTES environment variable (read once at first use).
+fn max_queued_bytes() -> usize {
+    static BUDGET: OnceLock<usize> = OnceLock::new();
+    *BUDGET.get_or_init(|| {
+        std::env::var("MQTT_MAX_QUEUED_BYTES")
+            .ok()
+            .and_then(|value| value.parse().ok())
+            .unwrap_or(DEFAULT_MAX_QUEUED_BYTES)
+    })
+}
+
+/// One queued frame: the encoded bytes plus the wall-clock deadline after
+/// which the MQTT 5 Message Expiry Interval says it must not be delivered.
+struct Frame {
+    data: Bytes,
+    expires_at: Option<Instant>,
+}
+
+/// Queue state shared between the enqueueing side and the writer thread.
+struct QueueState {
+    queue: VecDeque<Frame>, // Encoded packets waiting to be written
+    queued_bytes: usize,    // Total payload bytes queued; kept current on push/pop
+    dead: bool,             // Set once the socket has failed; sends are dropped
+    overflows: u32,         // Overflow events since the queue last drained
+}
+
+struct Shared {
+    pending: Mutex<QueueState>,
+    ready: Condvar, // Signals the writer thread that the queue is non-empty
+    inflight: Mutex<InflightWindow>, // QoS 1 messages awaiting this peer's PUBACK
+    socket: Option<TcpStream>, // Extra handle used to unblock the reader on shutdown
+    alive: AtomicBool, // Lock-free liveness flag, read by the eviction sweeps
+    pool: Option<Arc<PoolSignal>>, // Set when a pool thread drains this queue
+}
+
+impl Shared {
+    /// Wakes whichever writer drains this queue: the dedicated thread via
+    /// the per-queue condvar, or the owning pool thread via its signal.
+    fn notify_writer(&self) {
+        match &self.pool {
+            Some(signal) => {
+                *signal.pending.lock().unwrap() = true;
+                signal.ready.notify_one();
+            }
+            None => {
+                self.ready.notify_one();
+            }
+        }
+    }
+}
+
+/// Cloneable handle to a connection's outbound queue. Clones share the same
+/// queue and writer thread, so one handle can live in many topic lists.
+#[derive(Clone)]
+pub struct Outbound {
+    shared: Arc<Shared>,
+    peer: Option<SocketAddr>, // Cached at creation; only used for logging
+    id: u64,                  // Numeric connection ID assigned at accept time
+}
+
+impl Outbound {
+    /// Takes ownership of the write side of a stream and spawns its writer.
+    pub fn start(stream: TcpStream) -> Outbound {
+        let peer = stream.peer_addr().ok();
+        let shared = Arc::new(Shared {
+            pending: Mutex::new(QueueState {
+                queue: VecDeque::new(),
+                queued_bytes: 0,
+                dead: false,
+                overflows: 0,
+            }),
+            ready: Condvar::new(),
+            inflight: Mutex::new(InflightWindow::new()),
+            socket: stream.try_clone().ok(),
+            alive: AtomicBool::new(true),
+            pool: None,
+        });
+
+        let writer_shared = Arc::clone(&shared);
+        thread::spawn(move || {
+            run_writer(stream, writer_shared);
+        });
+
+        Outbound {
+            shared,
+            peer,
+            id: NEXT_CONNECTION_ID.fetch_add(1, Ordering::Relaxed),
+        }
+    }
+
+    /// The peer address cached when the connection was accepted.
+    pub fn peer_addr(&self) -> Option<SocketAddr> {
+        self.peer
+    }
+
+    /// The connection's numeric ID: a plain integer compare in the fan-out
+    /// loop, where a peer-address check would cost a syscall per delivery.
+    pub fn id(&self) -> u64 {
+        self.id
+    }
+
+    /// Whether this connection has failed or been shut down; a lock-free
+    /// read used when sweeping dead subscribers out of the topic lists.
+    pub fn is_dead(&self) -> bool {
+        !self.shared.alive.load(Ordering::Relaxed)
+    }
+
+    /// Enqueues an encoded packet for delivery. Never blocks on the network.
+    pub fn send(&self, data: Bytes) -> bool {
+        self.send_expiring(data, None)
+    }
+
+    /// Enqueues an encoded packet, optionally carrying an MQTT 5 Message
+    /// Expiry Interval in seconds; an expired frame is silently dropped at
+    /// flush time rather than delivered late. Never blocks on the network.
+    /// Returns false when the connection is already dead. A queue over its
+    /// frame or byte budget drops its oldest frames to make room; a
+    /// chronically overflowing connection is disconnected so it cannot hoard
+    /// memory forever.
+    pub fn send_expiring(&self, data: Bytes, expiry_secs: Option<u32>) -> bool {
+        let frame_len = data.len();
+        let mut state = self.shared.pending.lock().unwrap();
+        if state.dead {
+            return false;
+        }
+
+        // Both budgets are enforced right here on enqueue — constant work
+        // per message, never a scan of the whole queue
+        if state.queue.len() >= MAX_QUEUED
+            || state.queued_bytes + frame_len > max_queued_bytes()
+        {
+            state.overflows += 1;
+            metrics::count(&metrics::metrics().dropped_writes);
+
+            if state.overflows >= MAX_OVERFLOWS {
+                // Chronic slow consumer: say why, then cut it loose. The
+                // DISCONNECT replaces the whole backlog so it can actually
+                // reach the peer once the socket drains
+                let disconnect_packet =
+                    DisconnectPacket::new(DisconnectReasonCode::MessageRateTooHigh);
+                state.queue.clear();
+                state.queued_bytes = 0;
+                let frame = Bytes::from(disconnect_packet.encode());
+                state.queued_bytes += frame.len();
+                state.queue.push_back(Frame {
+                    data: frame,
+                    expires_at: None,
+                });
+                state.dead = true;
+                self.shared.notify_writer();
+                drop(state);
+                self.shared.alive.store(false, Ordering::Relaxed);
+                log_info!(
+                    "[-]Disconnecting chronic slow consumer: {:?}\n",
+                    self.peer
+                );
+                return false;
+            }
+
+            // Drop-oldest until the new frame fits: QoS 0 delivery is
+            // best-effort by definition
+            while !state.queue.is_empty()
+                && (state.queue.len() >= MAX_QUEUED
+                    || state.queued_bytes + frame_len > max_queued_bytes())
+            {
+                if let Some(front) = state.queue.pop_front() {
+                    state.queued_bytes -= front.data.len();
+                }
+            }
+        }
+
+        let expires_at =
+            expiry_secs.map(|secs| Instant::now() + Duration::from_secs(secs as u64));
+        state.queued_bytes += frame_len;
+        state.queue.push_back(Frame { data, expires_at });
+        self.shared.notify_writer();
+        true
+    }
+
+    /// Enqueues a QoS 1 PUBLISH, rewriting its message ID from this
+    /// session's inflight window so the peer's PUBACK can be matched.
+    /// Returns false when the window is full or the connection is dead.
+    pub fn send_qos1(&self, frame: &[u8], expiry_secs: Option<u32>) -> bool {
+        let rewritten = {
+            let mut window = self.shared.inflight.lock().unwrap();
+            let message_id = match window.reserve() {
+                Some(id) => id,
+                None => return false, // Window full: peer is not acking
+            };
+            match rewrite_message_id(frame, message_id) {
+                Some(rewritten) => {
+                    let bytes = Bytes::from(rewritten);
+                    window.track(message_id, bytes.clone());
+                    bytes
+                }
+                None => {
+                    window.acknowledge(message_id); // Release the reserved slot
+                    return false;
+                }
+            }
+        };
+        self.send_expiring(rewritten, expiry_secs)
+    }
+
+    /// Releases the inflight slot matching a PUBACK from this peer.
+    pub fn acknowledge(&self, message_id: u16) -> bool {
+        self.shared.inflight.lock().unwrap().acknowledge(message_id)
+    }
+
+    /// Marks the queue dead so the writer thread exits once it drains, and
+    /// shuts down the read side of the socket so a thread blocked in read()
+    /// (or an epoll worker waiting on readiness) observes the close at once.
+    pub fn shutdown(&self) {
+        {
+            let mut state = self.shared.pending.lock().unwrap();
+            state.dead = true;
+            self.shared.notify_writer();
+        }
+        self.shared.alive.store(false, Ordering::Relaxed);
+        if let Some(socket) = self.shared.socket.as_ref() {
+            let _ = socket.shutdown(Shutdown::Read);
+        }
+    }
+}
+
+/// How often the writer thread checks the inflight window for redelivery.
+const RETRANSMIT_CHECK: Duration = Duration::from_secs(1);
+
+/// Body of the writer thread: waits for packets and flushes them in batches,
+/// periodically re-enqueueing unacknowledged QoS 1 messages.
+fn run_writer(mut stream: TcpStream, shared: Arc<Shared>) {
+    loop {
+        // Take up to MAX_BATCH queued buffers in one go
+        let mut batch: Vec<Bytes> = {
+            let mut state = shared.pending.lock().unwrap();
+            while state.queue.is_empty() {
+                if state.dead {
+                    return;
+                }
+                let (next, timeout) = shared
+                    .ready
+                    .wait_timeout(state, RETRANSMIT_CHECK)
+                    .unwrap();
+                state = next;
+
+                // On a quiet connection, use the timeout to retransmit any
+                // QoS 1 message whose PUBACK is overdue (DUP flag set)
+                if timeout.timed_out() {
+                    for data in shared.inflight.lock().unwrap().stale_frames() {
+                        state.queued_bytes += data.len();
+                        state.queue.push_back(Frame {
+                            data,
+                            expires_at: None,
+                        });
+                    }
+                }
+            }
+            let take = state.queue.len().min(MAX_BATCH);
+            if take == state.queue.len() {
+                // Fully drained: the peer caught up, forgive past overflows
+                state.overflows = 0;
+            }
+
+            // Frames whose Message Expiry Interval lapsed while they sat in
+            // the queue are dropped here instead of delivered late
+            let now = Instant::now();
+            let mut batch = Vec::with_capacity(take);
+            let state = &mut *state;
+            for frame in state.queue.drain(..take) {
+                state.queued_bytes -= frame.data.len();
+                match frame.expires_at {
+                    Some(deadline) if deadline <= now => {
+                        metrics::count(&metrics::metrics().expired_messages);
+                    }
+                    _ => batch.push(frame.data),
+                }
+            }
+            batch
+        };
+
+        if batch.is_empty() {
+            continue; // Everything taken this round had expired
+        }
+
+        if !flush_batch(&mut stream, &mut batch) {
+            // The socket failed: mark the queue dead and stop; enqueued and
+            // future packets for this peer are dropped
+            shared.pending.lock().unwrap().dead = true;
+            shared.alive.store(false, Ordering::Relaxed);
+            return;
+        }
+    }
+}
+
+/// Writes a whole batch with vectored I/O, pausing while the peer's socket
+/// buffer drains. Returns false when the socket is no longer usable.
+fn flush_batch(stream: &mut TcpStream, batch: &mut Vec<Bytes>) -> bool {
+    loop {
+        match flush_nonblocking(stream, batch) {
+            FlushOutcome::Done => return true,
+            // The socket buffer is full; give the peer a moment to drain it
+            FlushOutcome::Blocked => thread::sleep(Duration::from_millis(1)),
+            FlushOutcome::Failed => return false,
+        }
+    }
+}
+
+/// Result of one non-blocking flush attempt over a batch.
+enum FlushOutcome {
+    Done,    // Every buffer fully written
+    Blocked, // Socket buffer full; the batch holds what remains, in order
+    Failed,  // Socket no longer usable
+}
+
+/// Writes as much of a batch as the socket accepts with vectored I/O,
+/// advancing across partial writes; never sleeps.
+fn flush_nonblocking(stream: &mut TcpStream, batch: &mut Vec<Bytes>) -> FlushOutcome {
+    while !batch.is_empty() {
+        let slices: Vec<IoSlice> = batch.iter().map(|b| IoSlice::new(b)).collect();
+
+        match stream.write_vectored(&slices) {
+            Ok(0) => return FlushOutcome::Failed,
+            Ok(mut written) => {
+                metrics::add(&metrics::metrics().bytes_out, written as u64);
+                // Drop fully written buffers and advance into a partial one
+                while written > 0 {
+                    if batch[0].len() <= written {
+                        written -= batch[0].len();
+                        batch.remove(0);
+                    } else {
+                        batch[0].advance(written);
+                        written = 0;
+                    }
+                }
+            }
+            Err(e) if e.kind() == ErrorKind::WouldBlock => return FlushOutcome::Blocked,
+            Err(e) if e.kind() == ErrorKind::Interrupted => {}
+            Err(e) => {
+                log_error!("[-]Error writing to subscriber: {}\n", e);
+                return FlushOutcome::Failed;
+            }
+        }
+    }
+    FlushOutcome::Done
+}
+
+/*
+The dedicated writer thread is the right trade for the thread-per-connection
+accept path, where the reader already costs a thread anyway — but in epoll
+mode it quietly reintroduced one OS thread per client on the write side,
+stacks and context switches included. The WriterPool gives the event engine a
+fixed set of writer threads instead: each connection is pinned to one pool
+thread at accept time, and that thread drains the queues of all its
+connections with the same batched, expiry-aware flush. Pool sockets are
+non-blocking, so a peer with a full socket buffer parks its remaining frames
+back on its own queue instead of stalling its neighbours.
+*/
+
+/// Wakeup shared by one pool thread and every queue it drains.
+struct PoolSignal {
+    pending: Mutex<bool>, // Set by any enqueue; cleared when the thread sweeps
+    ready: Condvar,
+}
+
+/// One connection serviced by a pool thread.
+struct PoolMember {
+    stream: TcpStream,
+    shared: Arc<Shared>,
+}
+
+/// One pool thread's connection list plus its wakeup signal.
+struct PoolWorker {
+    members: Mutex<Vec<PoolMember>>,
+    signal: Arc<PoolSignal>,
+}
+
+/// Fixed pool of writer threads multiplexing many connections' queues.
+pub struct WriterPool {
+    workers: Vec<Arc<PoolWorker>>,
+    next: AtomicUsize, // Round-robin assignment cursor
+}
+
+impl WriterPool {
+    /// Spawns `threads` writer threads, each draining its own set of queues.
+    pub fn start(threads: usize) -> WriterPool {
+        let mut workers = Vec::with_capacity(threads.max(1));
+        for _ in 0..threads.max(1) {
+            let worker = Arc::new(PoolWorker {
+                members: Mutex::new(Vec::new()),
+                signal: Arc::new(PoolSignal {
+                    pending: Mutex::new(false),
+                    ready: Condvar::new(),
+                }),
+            });
+            let thread_worker = Arc::clone(&worker);
+            thread::spawn(move || run_pool_worker(thread_worker));
+            workers.push(worker);
+        }
+        WriterPool {
+            workers,
+            next: AtomicUsize::new(0),
+        }
+    }
+
+    /// Builds an Outbound whose queue is drained by one of the pool threads
+    /// instead of a dedicated writer; the handle behaves identically.
+    pub fn attach(&self, stream: TcpStream) -> Outbound {
+        let worker =
+            &self.workers[self.next.fetch_add(1, Ordering::Relaxed) % self.workers.len()];
+
+        // The pool thread must never park inside write(2) on one peer while
+        // others have data waiting
+        let _ = stream.set_nonblocking(true);
+
+        let peer = stream.peer_addr().ok();
+        let shared = Arc::new(Shared {
+            pending: Mutex::new(QueueState {
+                queue: VecDeque::new(),
+                queued_bytes: 0,
+                dead: false,
+                overflows: 0,
+            }),
+            ready: Condvar::new(),
+            inflight: Mutex::new(InflightWindow::new()),
+            socket: stream.try_clone().ok(),
+            alive: AtomicBool::new(true),
+            pool: Some(Arc::clone(&worker.signal)),
+        });
+        worker.members.lock().unwrap().push(PoolMember {
+            stream,
+            shared: Arc::clone(&shared),
+        });
+
+        Outbound {
+            shared,
+            peer,
+            id: NEXT_CONNECTION_ID.fetch_add(1, Ordering::Relaxed),
+        }
+    }
+}
+
+/// Body of one pool thread: sweeps its connections whenever any of their
+/// queues has data, retransmitting stale QoS 1 frames on the same cadence as
+/// the dedicated writer.
+fn run_pool_worker(worker: Arc<PoolWorker>) {
+    let mut last_retransmit = Instant::now();
+    let mut skip_wait = false;
+
+    loop {
+        if !skip_wait {
+            let mut pending = worker.signal.pending.lock().unwrap();
+            while !*pending {
+                let (next, timeout) = worker
+                    .signal
+                    .ready
+                    .wait_timeout(pending, RETRANSMIT_CHECK)
+                    .unwrap();
+                pending = next;
+                if timeout.timed_out() {
+                    break; // Sweep anyway: stale QoS 1 frames may be due
+                }
+            }
+            *pending = false;
+        }
+        skip_wait = false;
+
+        let retransmit = last_retransmit.elapsed() >= RETRANSMIT_CHECK;
+        if retransmit {
+            last_retransmit = Instant::now();
+        }
+
+        let mut any_blocked = false;
+        let mut members = worker.members.lock().unwrap();
+        members.retain_mut(|member| service_member(member, retransmit, &mut any_blocked));
+        drop(members);
+
+        // A peer's socket buffer filled mid-batch: give it a moment to drain
+        // and sweep again — the same pause the dedicated writer takes on
+        // WouldBlock, but without stalling the other connections meanwhile
+        if any_blocked {
+            thread::sleep(Duration::from_millis(1));
+            skip_wait = true;
+        }
+    }
+}
+
+/// Drains one connection's queue as far as its socket allows. Returns false
+/// once the connection is dead and fully drained, so the pool forgets it.
+fn service_member(member: &mut PoolMember, retransmit: bool, any_blocked: &mut bool) -> bool {
+    let mut batch: Vec<Bytes> = {
+        let mut state = member.shared.pending.lock().unwrap();
+
+        // Re-enqueue QoS 1 messages whose PUBACK is overdue (DUP flag set),
+        // mirroring the dedicated writer's timeout branch
+        if retransmit {
+            for data in member.shared.inflight.lock().unwrap().stale_frames() {
+                state.queued_bytes += data.len();
+                state.queue.push_back(Frame {
+                    data,
+                    expires_at: None,
+                });
+            }
+        }
+
+        if state.queue.is_empty() {
+            return !state.dead; // Dead and drained: drop the member
+        }
+        let take = state.queue.len().min(MAX_BATCH);
+        if take == state.queue.len() {
+            // Fully drained: the peer caught up, forgive past overflows
+            state.overflows = 0;
+        }
+
+        // Frames whose Message Expiry Interval lapsed while they sat in the
+        // queue are dropped here instead of delivered late
+        let now = Instant::now();
+        let mut batch = Vec::with_capacity(take);
+        let state = &mut *state;
+        for frame in state.queue.drain(..take) {
+            state.queued_bytes -= frame.data.len();
+            match frame.expires_at {
+                Some(deadline) if deadline <= now => {
+                    metrics::count(&metrics::metrics().expired_messages);
+                }
+                _ => batch.push(frame.data),
+            }
+        }
+        batch
+    };
+
+    if batch.is_empty() {
+        return true; // Everything taken this round had expired
+    }
+
+    match flush_nonblocking(&mut member.stream, &mut batch) {
+        FlushOutcome::Done => true,
+        FlushOutcome::Blocked => {
+            // Park what did not fit back at the front of the queue, in
+            // order, and move on to the next connection
+            let mut state = member.shared.pending.lock().unwrap();
+            for data in batch.into_iter().rev() {
+                state.queued_bytes += data.len();
+                state.queue.push_front(Frame {
+                    data,
+                    expires_at: None,
+                });
+            }
+            *any_blocked = true;
+            true
+        }
+        FlushOutcome::Failed => {
+            // The socket failed: mark the queue dead; enqueued and future
+            // packets for this peer are dropped
+            member.shared.pending.lock().unwrap().dead = true;
+            member.shared.alive.store(false, Ordering::Relaxed);
+            false
+        }
+    }
+}
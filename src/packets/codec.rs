@@ -0,0 +1,248 @@
+/// Shared single-pass codec primitives for every MQTT packet module.
+
+/*
+Each packet module used to hand-roll its own Remaining Length VLQ loop and
+length-prefixed string reads through std::io::Cursor, paying a per-byte
+read_u8() call and allocating an error String on every fallible step — on the
+hottest CPU path in the broker.
+
+This module centralizes those primitives. The Reader walks a byte slice with
+plain indexed access (no Cursor, no io::Error), hands out borrowed &str and
+&[u8] views instead of copies wherever the caller allows it, and reports
+failures through a Copy error enum that never allocates. The write helpers
+mirror the same wire formats for encode().
+*/
+
+use std::fmt;
+
+/// Decode failure; a plain Copy enum so reporting an error costs nothing.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum CodecError {
+    Truncated,             // Ran out of bytes in the middle of a field
+    MalformedVarint,       // Remaining Length varint longer than 4 bytes
+    InvalidUtf8,           // A length-prefixed string is not valid UTF-8
+    InvalidPacketType(u8), // First byte does not carry the expected type
+    InvalidLength,         // Remaining Length inconsistent with the fields
+    InvalidValue(u8),      // A field value outside its legal range
+}
+
+impl fmt::Display for CodecError {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            CodecError::Truncated => write!(f, "packet truncated"),
+            CodecError::MalformedVarint => {
+                write!(f, "malformed Remaining Length: more than 4 bytes")
+            }
+            CodecError::InvalidUtf8 => write!(f, "string field is not valid UTF-8"),
+            CodecError::InvalidPacketType(byte) => {
+                write!(f, "invalid packet type: 0x{:02x}", byte)
+            }
+            CodecError::InvalidLength => write!(f, "invalid remaining length"),
+            CodecError::InvalidValue(value) => write!(f, "invalid field value: {}", value),
+        }
+    }
+}
+
+/// Bounds-checked reader over a packet's bytes: indexed access only, no
+/// Cursor and no io::Error in sight.
+pub struct Reader<'a> {
+    data: &'a [u8],
+    pos: usize,
+}
+
+impl<'a> Reader<'a> {
+    /// Wraps a byte slice for reading from the start.
+    pub fn new(data: &'a [u8]) -> Self {
+        Reader { data, pos: 0 }
+    }
+
+    /// Current offset into the slice.
+    pub fn position(&self) -> usize {
+        self.pos
+    }
+
+    /// Bytes not yet consumed, as a borrowed view.
+    pub fn remaining(&self) -> &'a [u8] {
+        &self.data[self.pos..]
+    }
+
+    /// Whether any bytes are left.
+    pub fn has_remaining(&self) -> bool {
+        self.pos < self.data.len()
+    }
+
+    /// Skips `count` bytes without looking at them.
+    pub fn skip(&mut self, count: usize) -> Result<(), CodecError> {
+        if self.pos + count > self.data.len() {
+            return Err(CodecError::Truncated);
+        }
+        self.pos += count;
+        Ok(())
+    }
+
+    /// Reads one byte.
+    pub fn read_u8(&mut self) -> Result<u8, CodecError> {
+        if self.pos >= self.data.len() {
+            return Err(CodecError::Truncated);
+        }
+        let byte = self.data[self.pos];
+        self.pos += 1;
+        Ok(byte)
+    }
+
+    /// Reads a big-endian u16.
+    pub fn read_u16(&mut self) -> Result<u16, CodecError> {
+        if self.pos + 2 > self.data.len() {
+            return Err(CodecError::Truncated);
+        }
+        let value = ((self.data[self.pos] as u16) << 8) | self.data[self.pos + 1] as u16;
+        self.pos += 2;
+        Ok(value)
+    }
+
+    /// Reads a big-endian u32.
+    pub fn read_u32(&mut self) -> Result<u32, CodecError> {
+        if self.pos + 4 > self.data.len() {
+            return Err(CodecError::Truncated);
+        }
+        let value = ((self.data[self.pos] as u32) << 24)
+            | ((self.data[self.pos + 1] as u32) << 16)
+            | ((self.data[self.pos + 2] as u32) << 8)
+            | self.data[self.pos + 3] as u32;
+        self.pos += 4;
+        Ok(value)
+    }
+
+    /// Reads the MQTT Remaining Length varint (1 to 4 bytes).
+    pub fn read_varint(&mut self) -> Result<usize, CodecError> {
+        let mut value = 0usize;
+        let mut multiplier = 1usize;
+        let mut count = 0;
+
+        loop {
+            if count >= 4 {
+                return Err(CodecError::MalformedVarint);
+            }
+            let byte = self.read_u8()?;
+            count += 1;
+            value += (byte & 0x7F) as usize * multiplier;
+            multiplier *= 128;
+
+            if (byte & 0x80) == 0 {
+                return Ok(value);
+            }
+        }
+    }
+
+    /// Reads `len` raw bytes as a borrowed view into the packet.
+    pub fn read_bytes(&mut self, len: usize) -> Result<&'a [u8], CodecError> {
+        if self.pos + len > self.data.len() {
+            return Err(CodecError::Truncated);
+        }
+        let bytes = &self.data[self.pos..self.pos + len];
+        self.pos += len;
+        Ok(bytes)
+    }
+
+    /// Reads a u16-length-prefixed byte field as a borrowed view.
+    pub fn read_prefixed_bytes(&mut self) -> Result<&'a [u8], CodecError> {
+        let len = self.read_u16()? as usize;
+        self.read_bytes(len)
+    }
+
+    /// Reads a u16-length-prefixed UTF-8 string as a borrowed &str; the
+    /// caller decides whether a copy is ever made.
+    pub fn read_str(&mut self) -> Result<&'a str, CodecError> {
+        let bytes = self.read_prefixed_bytes()?;
+        std::str::from_utf8(bytes).map_err(|_| CodecError::InvalidUtf8)
+    }
+}
+
+/// Appends the MQTT Remaining Length varint for `value`.
+pub fn write_varint(out: &mut Vec<u8>, mut value: usize) {
+    loop {
+        let mut byte = (value % 128) as u8;
+        value /= 128;
+        if value > 0 {
+            byte |= 0x80; // More varint bytes follow
+        }
+        out.push(byte);
+        if value == 0 {
+            break;
+        }
+    }
+}
+
+/// Appends a big-endian u16.
+pub fn write_u16(out: &mut Vec<u8>, value: u16) {
+    out.push((value >> 8) as u8);
+    out.push(value as u8);
+}
+
+/// Appends a big-endian u32.
+pub fn write_u32(out: &mut Vec<u8>, value: u32) {
+    out.push((value >> 24) as u8);
+    out.push((value >> 16) as u8);
+    out.push((value >> 8) as u8);
+    out.push(value as u8);
+}
+
+/// Appends a u16-length-prefixed UTF-8 string.
+pub fn write_str(out: &mut Vec<u8>, value: &str) {
+    write_u16(out, value.len() as u16);
+    out.extend_from_slice(value.as_bytes());
+}
+
+/*
+MQTT 5 property blocks are encoded here as a varint block length followed by
+one (identifier, u8 length, value) entry per property — the same TLV layout
+the DISCONNECT packet already used, so every module reads and writes
+properties the same way.
+*/
+
+/// Appends a property block: varint total length, then id/len/value entries.
+pub fn write_properties(out: &mut Vec<u8>, properties: &[(u8, Vec<u8>)]) {
+    write_varint(out, properties_block_len(properties));
+    for (identifier, value) in properties {
+        out.push(*identifier);
+        out.push(value.len() as u8);
+        out.extend_from_slice(value);
+    }
+}
+
+/// Length of the property entries alone (excluding the block-length varint).
+pub fn properties_block_len(properties: &[(u8, Vec<u8>)]) -> usize {
+    properties.iter().map(|(_, value)| 2 + value.len()).sum()
+}
+
+/// Full encoded size of a property block, varint prefix included.
+pub fn properties_wire_len(properties: &[(u8, Vec<u8>)]) -> usize {
+    let block = properties_block_len(properties);
+    varint_len(block) + block
+}
+
+impl<'a> Reader<'a> {
+    /// Reads a property block into owned (identifier, value) pairs.
+    pub fn read_properties(&mut self) -> Result<Vec<(u8, Vec<u8>)>, CodecError> {
+        let block_len = self.read_varint()?;
+        let block_end = self.position() + block_len;
+
+        let mut properties = Vec::new();
+        while self.position() < block_end {
+            let identifier = self.read_u8()?;
+            let value_len = self.read_u8()? as usize;
+            properties.push((identifier, self.read_bytes(value_len)?.to_vec()));
+        }
+        Ok(properties)
+    }
+}
+
+/// Number of bytes the Remaining Length varint for `value` occupies.
+pub fn varint_len(value: usize) -> usize {
+    match value {
+        0..=127 => 1,
+        128..=16_383 => 2,
+        16_384..=2_097_151 => 3,
+        _ => 4,
+    }
+}
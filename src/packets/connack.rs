@@ -4,8 +4,7 @@ The CONNACK packet is sent by the broker in response to a CONNECT packet from th
 It indicates the success or failure of the connection attempt and provides additional
  properties as per MQTT 5.0. */
 
-use std::io::{Read};
-use byteorder::{BigEndian, ReadBytesExt, WriteBytesExt};
+use crate::packets::codec::{self, CodecError, Reader};
 
 /// Represents the CONNACK packet in MQTT v5.0.
 #[derive(Debug, PartialEq, Clone)]
@@ -44,7 +43,7 @@ pub enum ConnAckReasonCode {
 
 impl ConnAckReasonCode {
     /// Decodes a reason code from a byte.
-    pub fn from_byte(byte: u8) -> Result<Self, String> {
+    pub fn from_byte(byte: u8) -> Result<Self, CodecError> {
         match byte {
             0x00 => Ok(ConnAckReasonCode::Success),
             0x80 => Ok(ConnAckReasonCode::UnspecifiedError),
@@ -68,7 +67,7 @@ impl ConnAckReasonCode {
             0x9C => Ok(ConnAckReasonCode::UseAnotherServer),
             0x9D => Ok(ConnAckReasonCode::ServerMoved),
             0x9F => Ok(ConnAckReasonCode::ConnectionRateExceeded),
-            _ => Err(format!("Unknown reason code: {}", byte)),
+            _ => Err(CodecError::InvalidValue(byte)),
         }
     }
 
@@ -128,17 +127,17 @@ impl ConnAckPacket {
         if let Some(ref props) = self.properties {
             if let Some(interval) = props.session_expiry_interval {
                 properties.push(0x11); // Property identifier for session expiry interval
-                properties.write_u32::<BigEndian>(interval).map_err(|e| e.to_string()).unwrap();
+                codec::write_u32(&mut properties, interval);
             }
 
             if let Some(maximum) = props.receive_maximum {
                 properties.push(0x21); // Property identifier for receive maximum
-                properties.write_u16::<BigEndian>(maximum).map_err(|e| e.to_string()).unwrap();
+                codec::write_u16(&mut properties, maximum);
             }
 
             if let Some(size) = props.maximum_packet_size {
                 properties.push(0x27); // Property identifier for maximum packet size
-                properties.write_u32::<BigEndian>(size).map_err(|e| e.to_string()).unwrap();
+                codec::write_u32(&mut properties, size);
             }
 
             if let Some(ref client_id) = props.assigned_client_identifier {
@@ -165,26 +164,28 @@ impl ConnAckPacket {
     }
 
     /// Decodes a CONNACK packet from bytes.
-    pub fn decode(data: &[u8]) -> Result<Self, String> {
-        let mut cursor = std::io::Cursor::new(data);
-        cursor.set_position(2);
+    pub fn decode(data: &[u8]) -> Result<Self, CodecError> {
+        let mut reader = Reader::new(data);
+
+        // Skip the packet-type byte and the Remaining Length varint
+        reader.read_u8()?;
+        reader.read_varint()?;
+
         // Read session present flag
-        let session_present = match cursor.read_u8().map_err(|e| e.to_string())? {
+        let session_present = match reader.read_u8()? {
             0 => false,
             1 => true,
-            _ => return Err("Invalid session present flag".to_string()),
+            value => return Err(CodecError::InvalidValue(value)),
         };
 
-
         // Read reason code
-        let reason_code = ConnAckReasonCode::from_byte(cursor.read_u8().map_err(|e| e.to_string())?)?;
+        let reason_code = ConnAckReasonCode::from_byte(reader.read_u8()?)?;
 
         // Read properties (if any)
         let mut properties = None;
-        let properties_length = cursor.read_u8().map_err(|e| e.to_string())? as usize;
+        let properties_length = reader.read_u8()? as usize;
         if properties_length > 0 {
-            let mut properties_data = vec![0; properties_length];
-            cursor.read_exact(&mut properties_data).map_err(|e| e.to_string())?;
+            reader.read_bytes(properties_length)?;
             // Decode properties (similar to encoding logic)
             properties = Some(ConnAckProperties {
                 session_expiry_interval: None, 
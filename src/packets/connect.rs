@@ -1,13 +1,12 @@
 /// MQTT Connect packet implementation for MQTT version 5.0.
 
-/* 
+/*
 The CONNECT packet is used to establish a connection between a client and a broker.
 This packet includes several fields that identify the client, specify connection settings,
      and allow for the broker to acknowledge the connection.
 */
 
-use std::io::{Read};
-use byteorder::{BigEndian, WriteBytesExt, ReadBytesExt};
+use crate::packets::codec::{self, CodecError, Reader};
 
 /*
 Implement traits for:
@@ -28,7 +27,7 @@ pub struct ConnectPacket {
     pub will_message: Option<String>, // Will message (optional)
     pub username: Option<String>,     // Username for authentication (optional)
     pub password: Option<String>,     // Password for authentication (optional)
-    
+
 }
 
 impl ConnectPacket {
@@ -65,61 +64,33 @@ impl ConnectPacket {
         packet.push(0x10);
 
         // Variable header length calculation
-        let mut remaining_length = 2 + self.protocol_name.len() as u16 + 1 // Protocol name & protocol level
+        let mut remaining_length = 2 + self.protocol_name.len() + 1 // Protocol name & protocol level
             + 1 // Connect flags byte
             + 2 // Keep alive
             + 2 // Client ID len field
-            + self.client_id.len() as u16; // Client ID
+            + self.client_id.len(); // Client ID
 
         //Evaluates if there are some optional fields
         if let Some(ref will_topic) = self.will_topic {
             //Will topic len field + will_topic len + will message len field + will_message len
-            remaining_length += 2 + will_topic.len() as u16 + 2 + self.will_message.as_ref().unwrap().len() as u16;
+            remaining_length += 2 + will_topic.len() + 2 + self.will_message.as_ref().unwrap().len();
         }
 
         if let Some(ref username) = self.username {
             //Username len field + username len
-            remaining_length += 2 + username.len() as u16;
+            remaining_length += 2 + username.len();
         }
 
         if let Some(ref password) = self.password {
             //Password len field + password len
-            remaining_length += 2 + password.len() as u16;
+            remaining_length += 2 + password.len();
         }
 
         // Encode the remaining length with VLQ codification
-        let mut len_buffer = Vec::new();
-        let mut length = remaining_length;
-        loop {
-            //Takes the 7 less significative bits.
-            let mut byte = (length % 128) as u8;
-            //Obtains the next 7 bits group
-            length /= 128;
-            //If there is another 7 bits group
-            if length > 0 {
-                /*Sets the most significant bit to 1 to
-                indicate there are more bytes */
-                byte |= 0x80; // 0x80 = 10000000
-            }
-            //Adds byte to the vector len_buffer
-            len_buffer.push(byte);
-            if length == 0 {
-                break;
-            }
-        }
-
-        // Add the remaining length bytes to the packet
-        packet.extend(len_buffer);
+        codec::write_varint(&mut packet, remaining_length);
 
-        /*
-        Using >>8 makes a right shift to leave only the 8 most significant bits
-        & 0xFF applies a mask bit by bit to leave only the 8 least significant bits
-        */
-
-        // Protocol Name
-        packet.push((self.protocol_name.len() >> 8) as u8); // Length of protocol name high byte
-        packet.push(self.protocol_name.len() as u8 & 0xFF); // Length of protocol name low byte
-        packet.extend_from_slice(self.protocol_name.as_bytes());
+        // Protocol Name (2-byte length prefix plus the bytes)
+        codec::write_str(&mut packet, &self.protocol_name);
 
         // Protocol Level (always 5 for MQTT v5.0)
         packet.push(self.protocol_level);
@@ -128,37 +99,25 @@ impl ConnectPacket {
         packet.push(self.connect_flags);
 
         // Keep Alive
-        packet.write_u16::<BigEndian>(self.keep_alive).unwrap();
+        codec::write_u16(&mut packet, self.keep_alive);
 
         // Client ID length and value
-        packet.push((self.client_id.len() >> 8) as u8); // High byte of client ID length
-        packet.push(self.client_id.len() as u8 & 0xFF); // Low byte of client ID length
-        packet.extend_from_slice(self.client_id.as_bytes());
+        codec::write_str(&mut packet, &self.client_id);
 
         // Will Topic and Message (if present)
         if let Some(ref will_topic) = self.will_topic {
-            packet.push((will_topic.len() >> 8) as u8);
-            packet.push(will_topic.len() as u8 & 0xFF);
-            packet.extend_from_slice(will_topic.as_bytes());
-
-            let will_message = self.will_message.as_ref().unwrap();
-            packet.push((will_message.len() >> 8) as u8);
-            packet.push(will_message.len() as u8 & 0xFF);
-            packet.extend_from_slice(will_message.as_bytes());
+            codec::write_str(&mut packet, will_topic);
+            codec::write_str(&mut packet, self.will_message.as_ref().unwrap());
         }
 
         // Username (if present)
         if let Some(ref username) = self.username {
-            packet.push((username.len() >> 8) as u8);
-            packet.push(username.len() as u8 & 0xFF);
-            packet.extend_from_slice(username.as_bytes());
+            codec::write_str(&mut packet, username);
         }
 
         // Password (if present)
         if let Some(ref password) = self.password {
-            packet.push((password.len() >> 8) as u8);
-            packet.push(password.len() as u8 & 0xFF);
-            packet.extend_from_slice(password.as_bytes());
+            codec::write_str(&mut packet, password);
         }
 
         packet
@@ -173,33 +132,27 @@ impl ConnectPacket {
     /// # Returns
     ///
     /// This function returns a result containing either a decoded `ConnectPacket` or an error if decoding fails.
-    pub fn decode(data: &[u8]) -> Result<Self, String> {
-        let mut cursor = std::io::Cursor::new(data);
-        //Move two places due to the fixed header
-        cursor.set_position(2);
- 
-        // Extracts the protocol name length 
-        let protocol_name_len = cursor.read_u16::<BigEndian>().map_err(|e| e.to_string())? as usize;
-        //Sets a mut vector of the size extracted
-        let mut protocol_name = vec![0; protocol_name_len];
-        //Parse the name into a string and saves it into the mut vector
-        cursor.read_exact(&mut protocol_name).map_err(|e| e.to_string())?;
-        let protocol_name = String::from_utf8(protocol_name).map_err(|e| e.to_string())?;
+    pub fn decode(data: &[u8]) -> Result<Self, CodecError> {
+        let mut reader = Reader::new(data);
+
+        // Skip the packet-type byte, then the Remaining Length varint
+        reader.read_u8()?;
+        reader.read_varint()?;
+
+        // Extracts the protocol name (borrowed, then owned for the packet)
+        let protocol_name = reader.read_str()?.to_string();
 
         // Extract the protocol level
-        let protocol_level = cursor.read_u8().map_err(|e| e.to_string())?;
+        let protocol_level = reader.read_u8()?;
 
         // Extract the connect flags
-        let connect_flags = cursor.read_u8().map_err(|e| e.to_string())?;
+        let connect_flags = reader.read_u8()?;
 
         // Extract keep alive time
-        let keep_alive = cursor.read_u16::<BigEndian>().map_err(|e| e.to_string())?;
+        let keep_alive = reader.read_u16()?;
 
         // Read client ID length and value
-        let client_id_len = cursor.read_u16::<BigEndian>().map_err(|e| e.to_string())? as usize;
-        let mut client_id = vec![0; client_id_len];
-        cursor.read_exact(&mut client_id).map_err(|e| e.to_string())?;
-        let client_id = String::from_utf8(client_id).map_err(|e| e.to_string())?;
+        let client_id = reader.read_str()?.to_string();
 
         // Parse optional fields: Will, Username, Password
         let mut will_topic = None;
@@ -209,31 +162,18 @@ impl ConnectPacket {
 
         // Will Topic and Message
         if connect_flags & 0x04 != 0 {
-            let will_topic_len = cursor.read_u16::<BigEndian>().map_err(|e| e.to_string())? as usize;
-            let mut will_topic_bytes = vec![0; will_topic_len];
-            cursor.read_exact(&mut will_topic_bytes).map_err(|e| e.to_string())?;
-            will_topic = Some(String::from_utf8(will_topic_bytes).map_err(|e| e.to_string())?);
-
-            let will_message_len = cursor.read_u16::<BigEndian>().map_err(|e| e.to_string())? as usize;
-            let mut will_message_bytes = vec![0; will_message_len];
-            cursor.read_exact(&mut will_message_bytes).map_err(|e| e.to_string())?;
-            will_message = Some(String::from_utf8(will_message_bytes).map_err(|e| e.to_string())?);
+            will_topic = Some(reader.read_str()?.to_string());
+            will_message = Some(reader.read_str()?.to_string());
         }
 
         // Username
         if connect_flags & 0x80 != 0 {
-            let username_len = cursor.read_u16::<BigEndian>().map_err(|e| e.to_string())? as usize;
-            let mut username_bytes = vec![0; username_len];
-            cursor.read_exact(&mut username_bytes).map_err(|e| e.to_string())?;
-            username = Some(String::from_utf8(username_bytes).map_err(|e| e.to_string())?);
+            username = Some(reader.read_str()?.to_string());
         }
 
         // Password
         if connect_flags & 0x40 != 0 {
-            let password_len = cursor.read_u16::<BigEndian>().map_err(|e| e.to_string())? as usize;
-            let mut password_bytes = vec![0; password_len];
-            cursor.read_exact(&mut password_bytes).map_err(|e| e.to_string())?;
-            password = Some(String::from_utf8(password_bytes).map_err(|e| e.to_string())?);
+            password = Some(reader.read_str()?.to_string());
         }
 
         //Return the connect packet with the parsed information
@@ -249,4 +189,4 @@ impl ConnectPacket {
             password,
         })
     }
-}
\ No newline at end of file
+}
@@ -1,5 +1,7 @@
 use std::collections::HashMap;
 
+use crate::packets::codec::{CodecError, Reader};
+
 #[derive(Debug, Clone)]
 pub enum DisconnectReasonCode {
     NormalDisconnection = 0x00,
@@ -18,9 +20,9 @@ pub enum DisconnectReasonCode {
     TopicNameInvalid = 0x90,
     ReceiveMaximumExceeded = 0x93,
     TopicAliasInvalid = 0x94,
-    PacketTooLarge = 0x95,
+    PacketTooLarge = 0x95,*/
     MessageRateTooHigh = 0x96,
-    QuotaExceeded = 0x97,
+    /*QuotaExceeded = 0x97,
     AdministrativeAction = 0x98,
     PayloadFormatInvalid = 0x99,
     RetainNotSupported = 0x9A,
@@ -41,6 +43,7 @@ impl DisconnectReasonCode {
             0x04 => Some(DisconnectReasonCode::DisconnectWithWillMessage),
             0x8B => Some(DisconnectReasonCode::ServerShuttingDown),
             0x8D => Some(DisconnectReasonCode::KeepAliveTimeout),
+            0x96 => Some(DisconnectReasonCode::MessageRateTooHigh),
             //Future cases ...
             _ => None,
         }
@@ -89,46 +92,28 @@ impl DisconnectPacket {
     }
 
     /// Decode a disconnect packet from a byte slice
-    pub fn decode(packet: &[u8]) -> Result<Self, &'static str> {
-        if packet.len() < 3 {
-            return Err("Packet too short to decode");
-        }
+    pub fn decode(packet: &[u8]) -> Result<Self, CodecError> {
+        let mut reader = Reader::new(packet);
 
-        let mut index = 1; // Skip the fixed header byte
-
-        // Get the length of the variable header
-        let variable_header_len = packet[index] as usize;
+        // Skip the fixed header byte, then read the variable header length
+        reader.read_u8()?;
+        let variable_header_len = reader.read_u8()? as usize;
         if packet.len() < variable_header_len + 2 {
-            return Err("Packet length mismatch");
+            return Err(CodecError::InvalidLength);
         }
-        index += 1; // Move to the reason code
 
         // Extract the reason code (1 byte)
-        let reason_code_value = packet[index];
+        let reason_code_value = reader.read_u8()?;
         let reason_code = DisconnectReasonCode::from_u8(reason_code_value)
-            .ok_or("Invalid reason code")?;
-        index += 1; // Move to properties
+            .ok_or(CodecError::InvalidValue(reason_code_value))?;
 
         // Extract properties
         let mut properties = HashMap::new();
-        while index < packet.len() {
-            if index + 1 >= packet.len() {
-                return Err("Property length missing");
-            }
-
-            let property_identifier = packet[index];
-            index += 1;
-
-            let property_length = packet[index] as usize;
-            index += 1;
-
-            if index + property_length > packet.len() {
-                return Err("Property data out of bounds");
-            }
-
-            let property_value = packet[index..index + property_length].to_vec();
+        while reader.has_remaining() {
+            let property_identifier = reader.read_u8()?;
+            let property_length = reader.read_u8()? as usize;
+            let property_value = reader.read_bytes(property_length)?.to_vec();
             properties.insert(property_identifier, property_value);
-            index += property_length;
         }
 
         Ok(DisconnectPacket {
@@ -1,3 +1,4 @@
+pub mod codec;
 pub mod connect;
 pub mod connack;
 pub mod publish;
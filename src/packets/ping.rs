@@ -1,6 +1,8 @@
 use bytes::Bytes;
 use bytes::{BytesMut, BufMut};
 
+use crate::packets::codec::CodecError;
+
 /// MQTT Packet Type
 const PINGREQ: u8 = 0b1100_0000; // Packet type for PINGREQ with flags (0b1100)
 const PINGRESP: u8 = 0b1101_0000; // Packet type for PINGRESP with flags (0b1101)
@@ -31,12 +33,12 @@ impl PingRespPacket {
     }
 
     /// Decodes a PINGRESP packet from bytes
-    pub fn decode(bytes: &Bytes) -> Result<Self, &'static str> {
+    pub fn decode(bytes: &Bytes) -> Result<Self, CodecError> {
         if bytes.len() != 2 {
-            return Err("Invalid PINGRESP packet length");
+            return Err(CodecError::InvalidLength);
         }
         if bytes[0] != PINGRESP || bytes[1] != 0x00 {
-            return Err("Invalid PINGRESP packet format");
+            return Err(CodecError::InvalidPacketType(bytes[0]));
         }
         Ok(PingRespPacket)
     }
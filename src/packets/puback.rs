@@ -1,13 +1,13 @@
 /// MQTT PUBACK packet implementation for MQTT version 5.0.
 
-/// 
+///
 /// The PUBACK packet is used to acknowledge receipt of a published message.
-/// When a client sends a message with QoS 1 (at least once delivery), 
+/// When a client sends a message with QoS 1 (at least once delivery),
 /// it expects a PUBACK packet from the receiver (broker or client).
 /// The PUBACK packet includes the message identifier (Packet ID) to match the message it acknowledges.
 ///
 
-use byteorder::{BigEndian, WriteBytesExt, ReadBytesExt};
+use crate::packets::codec::{self, CodecError, Reader};
 
 /*
 Implementing traits for:
@@ -40,31 +40,12 @@ impl PubAckPacket {
         // Fixed header (first byte): PUBACK packet type (0x40)
         packet.push(0x40);  // PUBACK packet type (MQTT Control Packet type for PUBACK)
 
-        // Remaining length (2 bytes): The length of the variable header (just the packet ID)
-        // In MQTT v5.0, this is a simple 2-byte integer (the packet ID).
-        let remaining_length = 2; // Remaining length = 2 bytes for packet_id
-
-        // Encode the remaining length with VLQ (Variable Length Quantity) encoding
-        let mut len_buffer = Vec::new();
-        let mut length = remaining_length;
-        loop {
-            let mut byte = (length % 128) as u8; // Get the least significant 7 bits
-            length /= 128;
-            if length > 0 {
-                byte |= 0x80; // Set the most significant bit to indicate more bytes
-            }
-            len_buffer.push(byte);
-            if length == 0 {
-                break;
-            }
-        }
-
-        // Add the remaining length bytes to the packet
-        packet.extend(len_buffer);
+        // Remaining length: just the 2-byte packet ID in the variable header
+        codec::write_varint(&mut packet, 2);
 
         // The variable header contains the packet identifier (2 bytes)
         // The packet_id uniquely identifies the message being acknowledged
-        packet.write_u16::<BigEndian>(self.packet_id).unwrap();
+        codec::write_u16(&mut packet, self.packet_id);
 
         // Return the encoded packet as a byte vector
         packet
@@ -78,55 +59,29 @@ impl PubAckPacket {
     ///
     /// # Returns
     ///
-    /// This function returns a Result that contains either the decoded `PubAckPacket` 
+    /// This function returns a Result that contains either the decoded `PubAckPacket`
     /// or an error if the decoding fails.
-    pub fn decode(data: &[u8]) -> Result<Self, String> {
-        let mut cursor = std::io::Cursor::new(data);
+    pub fn decode(data: &[u8]) -> Result<Self, CodecError> {
+        let mut reader = Reader::new(data);
 
         // Read the fixed header (first byte), it should be 0x40 for PUBACK
-        let packet_type = cursor.read_u8().map_err(|e| e.to_string())?;
+        let packet_type = reader.read_u8()?;
         if packet_type != 0x40 {
-            return Err(format!("Invalid packet type: 0x{:02x}", packet_type));
+            return Err(CodecError::InvalidPacketType(packet_type));
         }
 
-        // Read the remaining length (skip the length bytes in the header)
-        let remaining_length = read_remaining_length(&mut cursor)?;
+        // Read the remaining length (single-pass varint)
+        let remaining_length = reader.read_varint()?;
 
         // Check if the remaining length matches the expected value for PUBACK (2 bytes for packet_id)
         if remaining_length != 2 {
-            return Err(format!("Invalid remaining length: {}", remaining_length));
+            return Err(CodecError::InvalidLength);
         }
 
         // Read the Packet ID (2 bytes)
-        let packet_id = cursor.read_u16::<BigEndian>().map_err(|e| e.to_string())?;
+        let packet_id = reader.read_u16()?;
 
         // Return the decoded PUBACK packet
         Ok(PubAckPacket { packet_id })
     }
 }
-
-/// Helper function to read the remaining length field (Variable Length Quantity encoding)
-/// This function reads the remaining length from the MQTT packet header.
-/// 
-/// # Arguments
-///
-/// * `cursor` - A cursor over the byte slice from which to read the remaining length.
-///
-/// # Returns
-/// The remaining length value as an integer.
-///
-fn read_remaining_length(cursor: &mut std::io::Cursor<&[u8]>) -> Result<usize, String> {
-    let mut multiplier = 1;
-    let mut value = 0;
-
-    loop {
-        let byte = cursor.read_u8().map_err(|e| e.to_string())?;
-        value += (byte & 0x7F) as usize * multiplier;
-        if (byte & 0x80) == 0 {
-            break;
-        }
-        multiplier *= 128;
-    }
-
-    Ok(value)
-}
\ No newline at end of file
@@ -5,8 +5,8 @@ The PUBLISH packet is used to send messages from a client to a broker, or from a
 This packet includes the message content, topic name, and various flags that control the message's behavior.
 */
 
-use std::io::Read;
-use byteorder::{BigEndian, WriteBytesExt, ReadBytesExt};
+use crate::packets::codec::{self, CodecError, Reader};
+use std::collections::HashMap;
 
 /*
 Implement traits for:
@@ -22,9 +22,15 @@ pub struct PublishPacket {
     pub qos: u8,                  // Quality of Service level (0, 1, or 2)
     pub retain: bool,             // Retain flag (whether the message should be retained by the broker)
     pub dup: bool,                // Duplicate delivery flag (for QoS 1 and 2)
+    pub properties: Vec<(u8, Vec<u8>)>, // MQTT 5 properties as (identifier, value) pairs
     pub payload: Vec<u8>,         // The actual message payload (data)
 }
 
+/// MQTT 5 property identifier: Message Expiry Interval (four byte integer).
+pub const PROP_MESSAGE_EXPIRY_INTERVAL: u8 = 0x02;
+/// MQTT 5 property identifier: Topic Alias (two byte integer).
+pub const PROP_TOPIC_ALIAS: u8 = 0x23;
+
 impl PublishPacket {
     // Constructor for a PublishPacket, with all fields as parameters
     pub fn new(
@@ -41,10 +47,22 @@ impl PublishPacket {
             qos,
             retain,
             dup,
+            properties: Vec::new(),
             payload,
         }
     }
 
+    /// Attaches an MQTT 5 property as a raw (identifier, value) pair.
+    pub fn add_property(&mut self, identifier: u8, value: Vec<u8>) {
+        self.properties.push((identifier, value));
+    }
+
+    /// Sets the Topic Alias property (0x23) so the topic string can be
+    /// elided on later publishes over the same connection.
+    pub fn set_topic_alias(&mut self, alias: u16) {
+        self.add_property(PROP_TOPIC_ALIAS, vec![(alias >> 8) as u8, alias as u8]);
+    }
+
     /// Encodes the Publish packet into bytes to send to the broker.
     pub fn encode(&self) -> Vec<u8> {
         let mut packet = Vec::new();
@@ -65,37 +83,31 @@ impl PublishPacket {
         packet.push(first_byte);
 
         // Variable header length calculation
-        let mut remaining_length = 2 + self.topic_name.len() as u16 + self.payload.len() as u16;
+        let mut remaining_length = 2 + self.topic_name.len() + self.payload.len();
 
         if self.qos > 0 {
             // Add message ID field (2 bytes) for QoS 1 and 2
             remaining_length += 2;
         }
 
+        // MQTT 5 property block (always present, possibly empty)
+        remaining_length += codec::properties_wire_len(&self.properties);
+
         // Encode the remaining length with VLQ codification
-        let mut len_buffer = Vec::new();
-        let mut length = remaining_length;
-        loop {
-            let mut byte = (length % 128) as u8;
-            length /= 128;
-            if length > 0 {
-                byte |= 0x80; // 0x80 = 10000000, indicates more bytes
-            }
-            len_buffer.push(byte);
-            if length == 0 {
-                break;
-            }
-        }
+        codec::write_varint(&mut packet, remaining_length);
 
-        // Add the remaining length bytes to the packet
-        packet.extend(len_buffer);
+        // Topic Name: topic length (2 bytes) followed by the topic itself
+        codec::write_str(&mut packet, &self.topic_name);
 
-        // Topic Name: Encode the topic length (2 bytes) followed by the topic itself
-        packet.push((self.topic_name.len() >> 8) as u8); // High byte of topic length
-        packet.push(self.topic_name.len() as u8 & 0xFF); // Low byte of topic length
-        packet.extend_from_slice(self.topic_name.as_bytes());
+        // The message ID only exists on the wire for QoS 1 and 2, exactly
+        // as decode expects; writing it for QoS 0 would make the body two
+        // bytes longer than the Remaining Length claims
+        if self.qos > 0 {
+            codec::write_u16(&mut packet, self.message_id);
+        }
 
-        packet.write_u16::<BigEndian>(self.message_id).unwrap();
+        // Properties: varint block length, then (identifier, length, value) entries
+        codec::write_properties(&mut packet, &self.properties);
 
         // Payload: Add the actual message content
         packet.extend_from_slice(&self.payload);
@@ -112,49 +124,150 @@ impl PublishPacket {
     /// # Returns
     ///
     /// This function returns a result containing either a decoded `PublishPacket` or an error if decoding fails.
-    pub fn decode(data: &[u8]) -> Result<Self, String> {
-        let mut cursor = std::io::Cursor::new(data);
-    
-        //Read the first byte (packet type and flags)
-        let first_byte = cursor.read_u8().map_err(|e| e.to_string())?;
-    
-        //Decode the rest of the package in VLQ
-        let mut remaining_length = 0u16;
-        let mut multiplier = 1u16;
-        loop {
-            let byte = cursor.read_u8().map_err(|e| e.to_string())?;
-            remaining_length += (byte & 127) as u16 * multiplier;
-            multiplier *= 128;
-            if (byte & 128) == 0 {
-                break;
-            }
-        }
-    
-        //Read the topic lenght (2 bytes) and the topic name
-        let topic_name_len = cursor.read_u16::<BigEndian>().map_err(|e| e.to_string())? as usize;
-        let mut topic_name = vec![0; topic_name_len];
-        cursor.read_exact(&mut topic_name).map_err(|e| e.to_string())?;
-        let topic_name = String::from_utf8(topic_name).map_err(|e| e.to_string())?;
-    
-        //Read the message ID if qos is > 0)
+    pub fn decode(data: &[u8]) -> Result<Self, CodecError> {
+        let mut reader = Reader::new(data);
+
+        // Read the first byte (packet type and flags)
+        let first_byte = reader.read_u8()?;
+
+        // Decode the Remaining Length varint in a single pass
+        let remaining_length = reader.read_varint()?;
+        let body_start = reader.position();
+
+        // Topic length (2 bytes) and the topic name, borrowed from the frame
+        let topic_name = reader.read_str()?.to_string();
+
+        // Read the message ID if qos is > 0
         let qos = (first_byte >> 1) & 0x03;
-        let message_id = if qos > 0 {
-            cursor.read_u16::<BigEndian>().map_err(|e| e.to_string())?
-        } else {
-            0
-        };
-    
-        // Read the payload (remaining data)
-        let mut payload = Vec::new();
-        cursor.read_to_end(&mut payload).map_err(|e| e.to_string())?;
-    
+        let message_id = if qos > 0 { reader.read_u16()? } else { 0 };
+
+        // MQTT 5 property block
+        let properties = reader.read_properties()?;
+
+        // The payload is whatever the Remaining Length says is left
+        let header_len = reader.position() - body_start;
+        let payload_len = remaining_length
+            .checked_sub(header_len)
+            .ok_or(CodecError::InvalidLength)?;
+        let payload = reader.read_bytes(payload_len)?.to_vec();
+
         Ok(PublishPacket {
             topic_name,
             message_id,
             qos,
             retain: first_byte & 0x01 != 0,
             dup: first_byte & 0x08 != 0,
+            properties,
+            payload,
+        })
+    }
+}
+
+/*
+For routing, the broker only needs the topic, the QoS bits and the message
+ID; copying a large payload into a fresh Vec just to forward the original
+wire bytes unchanged is a wasted memcpy per inbound message. The view parses
+the header fields and leaves topic and payload as borrowed slices of the
+receive buffer, so the hot PUBLISH path touches none of the body. Consumers
+that really need an owned copy still call PublishPacket::decode().
+*/
+
+/// Borrowed view of a PUBLISH packet: header parsed, payload untouched.
+#[derive(Debug)]
+pub struct PublishView<'a> {
+    pub topic_name: &'a str, // Borrowed from the receive buffer
+    pub message_id: u16,     // Zero for QoS 0
+    pub qos: u8,             // Quality of Service level (0, 1, or 2)
+    pub retain: bool,        // Retain flag
+    pub dup: bool,           // Duplicate delivery flag
+    pub topic_alias: Option<u16>,    // Topic Alias property (0x23), if present
+    pub message_expiry: Option<u32>, // Message Expiry Interval property (0x02), if present
+    pub payload: &'a [u8],   // Borrowed from the receive buffer, never copied
+}
+
+impl<'a> PublishView<'a> {
+    /// Parses the PUBLISH header without copying topic or payload.
+    pub fn parse(data: &'a [u8]) -> Result<Self, CodecError> {
+        let mut reader = Reader::new(data);
+
+        let first_byte = reader.read_u8()?;
+        let remaining_length = reader.read_varint()?;
+        let body_start = reader.position();
+
+        let topic_name = reader.read_str()?;
+
+        let qos = (first_byte >> 1) & 0x03;
+        let message_id = if qos > 0 { reader.read_u16()? } else { 0 };
+
+        // Scan the property block in place: the broker only routes on the
+        // Topic Alias and Message Expiry values, so everything else is
+        // skipped without allocating.
+        let mut topic_alias = None;
+        let mut message_expiry = None;
+        let block_len = reader.read_varint()?;
+        let block_end = reader.position() + block_len;
+        while reader.position() < block_end {
+            let identifier = reader.read_u8()?;
+            let value_len = reader.read_u8()? as usize;
+            match identifier {
+                PROP_TOPIC_ALIAS if value_len == 2 => {
+                    topic_alias = Some(reader.read_u16()?);
+                }
+                PROP_MESSAGE_EXPIRY_INTERVAL if value_len == 4 => {
+                    message_expiry = Some(reader.read_u32()?);
+                }
+                _ => reader.skip(value_len)?,
+            }
+        }
+
+        let header_len = reader.position() - body_start;
+        let payload_len = remaining_length
+            .checked_sub(header_len)
+            .ok_or(CodecError::InvalidLength)?;
+        let payload = reader.read_bytes(payload_len)?;
+
+        Ok(PublishView {
+            topic_name,
+            message_id,
+            qos,
+            retain: first_byte & 0x01 != 0,
+            dup: first_byte & 0x08 != 0,
+            topic_alias,
+            message_expiry,
             payload,
         })
     }
 }
+
+/*
+Topic aliases are scoped to a single connection: a PUBLISH carrying both a
+topic and an alias registers the pair, and later publishes may send a
+two-byte alias with an empty topic instead of repeating the string. Both
+read paths (thread-per-connection and the epoll engine) keep one table per
+connection and call this helper to resolve the effective topic.
+*/
+
+/// Resolves the effective topic of a parsed PUBLISH against the
+/// connection's alias table, learning new alias pairs along the way.
+/// Returns None when a topic-less publish names an alias the connection
+/// never registered.
+pub fn resolve_topic_alias<'a>(
+    topic_name: &'a str,
+    topic_alias: Option<u16>,
+    aliases: &'a mut HashMap<u16, String>,
+) -> Option<&'a str> {
+    if let Some(alias) = topic_alias {
+        if !topic_name.is_empty() {
+            // Full topic plus alias: remember the pair for later publishes
+            aliases.insert(alias, topic_name.to_string());
+            return Some(topic_name);
+        }
+        // Empty topic: the alias must already be registered
+        return aliases.get(&alias).map(|topic| topic.as_str());
+    }
+    if topic_name.is_empty() {
+        None
+    } else {
+        Some(topic_name)
+    }
+}
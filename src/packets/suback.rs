@@ -12,7 +12,7 @@
 /// - 0x80: Failure (Invalid Topic Filter)
 ///
 
-use byteorder::{BigEndian, WriteBytesExt, ReadBytesExt};
+use crate::packets::codec::{self, CodecError, Reader};
 
 #[derive(Debug, PartialEq, Clone)]
 /// The SUBACK packet structure as defined in MQTT 5.0
@@ -45,38 +45,14 @@ impl SubAckPacket {
         // Fixed header (first byte): SUBACK packet type (0x90) with reserved bits (1001)
         packet.push(0x90);
 
-        // Variable header:
-        // Packet Identifier (2 bytes)
-        let mut variable_header = Vec::new();
-        variable_header.write_u16::<BigEndian>(self.packet_id).unwrap();
+        // Remaining length: packet ID (2 bytes) plus one return code per filter
+        codec::write_varint(&mut packet, 2 + self.return_codes.len());
 
-        // Payload:
-        // Return codes (1 byte for each topic filter's result)
-        let mut payload = Vec::new();
-        for return_code in &self.return_codes {
-            payload.push(*return_code);
-        }
-
-        // Remaining length (Variable Header + Payload size)
-        let remaining_length = variable_header.len() + payload.len();
-        let mut len_buffer = Vec::new();
-        let mut length = remaining_length;
-        loop {
-            let mut byte = (length % 128) as u8;
-            length /= 128;
-            if length > 0 {
-                byte |= 0x80;
-            }
-            len_buffer.push(byte);
-            if length == 0 {
-                break;
-            }
-        }
+        // Variable header: Packet Identifier (2 bytes)
+        codec::write_u16(&mut packet, self.packet_id);
 
-        // Assemble the packet
-        packet.extend(len_buffer); // Add remaining length
-        packet.extend(variable_header); // Add variable header
-        packet.extend(payload); // Add payload
+        // Payload: Return codes (1 byte for each topic filter's result)
+        packet.extend_from_slice(&self.return_codes);
 
         packet
     }
@@ -88,32 +64,27 @@ impl SubAckPacket {
     /// * `data` - A byte slice representing the SUBACK packet.
     ///
     /// # Returns
-    /// This function returns a Result that contains either the decoded `SubAckPacket` 
+    /// This function returns a Result that contains either the decoded `SubAckPacket`
     /// or an error if the decoding fails.
-    pub fn decode(data: &[u8]) -> Result<Self, String> {
-        let mut cursor = std::io::Cursor::new(data);
+    pub fn decode(data: &[u8]) -> Result<Self, CodecError> {
+        let mut reader = Reader::new(data);
 
         // Read the fixed header (first byte), it should be 0x90 for SUBACK
-        let packet_type = cursor.read_u8().map_err(|e| e.to_string())?;
+        let packet_type = reader.read_u8()?;
         if packet_type != 0x90 {
-            return Err(format!("Invalid packet type: 0x{:02x}", packet_type));
+            return Err(CodecError::InvalidPacketType(packet_type));
         }
 
         // Read the remaining length
-        let remaining_length = read_remaining_length(&mut cursor)?;
+        let remaining_length = reader.read_varint()?;
 
         // Read the Packet Identifier (2 bytes)
-        let packet_id = cursor.read_u16::<BigEndian>().map_err(|e| e.to_string())?;
+        let packet_id = reader.read_u16()?;
 
-        // Read the payload (Return Codes)
-        let mut return_codes = Vec::new();
-        let mut bytes_read = 2; // Start with the 2 bytes of the packet_id
-        while bytes_read < remaining_length {
-            // Read each return code (1 byte per Topic Filter)
-            let return_code = cursor.read_u8().map_err(|e| e.to_string())?;
-            bytes_read += 1;
-            return_codes.push(return_code);
-        }
+        // Read the payload (Return Codes): one byte per Topic Filter
+        let return_codes = reader
+            .read_bytes(remaining_length.checked_sub(2).ok_or(CodecError::InvalidLength)?)?
+            .to_vec();
 
         // Return the decoded SubAckPacket
         Ok(SubAckPacket {
@@ -122,20 +93,3 @@ impl SubAckPacket {
         })
     }
 }
-
-/// Helper function to read the remaining length field (Variable Length Quantity encoding)
-fn read_remaining_length(cursor: &mut std::io::Cursor<&[u8]>) -> Result<usize, String> {
-    let mut multiplier = 1;
-    let mut value = 0;
-
-    loop {
-        let byte = cursor.read_u8().map_err(|e| e.to_string())?;
-        value += (byte & 0x7F) as usize * multiplier;
-        if (byte & 0x80) == 0 {
-            break;
-        }
-        multiplier *= 128;
-    }
-
-    Ok(value)
-}
\ No newline at end of file
@@ -0,0 +1,265 @@
+/// Durable session storage: append-only log, compaction, startup replay.
+
+/*
+Every restart used to drop all session state, and a fleet re-subscribing its
+full filter load takes minutes of SUBSCRIBE traffic before the broker is
+useful again.
+
+This module persists each client's subscription filters to an append-only
+text log. The hot path only appends a record to an in-memory mirror and
+sends it over a channel — a dedicated I/O thread owns the file, so
+handle_client() and the epoll workers never block on disk. The writer
+compacts periodically: once enough records accumulate it rewrites the log
+from the mirror (one line per live subscription) and swaps it in with a
+rename, so the file stays proportional to live state, not to history.
+
+At startup the log is replayed once into a map of client ID to filters.
+When a client reconnects without the Clean Session flag, its stored filters
+are re-linked into the subscription table immediately, so it starts
+receiving messages without re-sending a single SUBSCRIBE. A CONNECT with
+Clean Session wipes the client's stored state instead.
+
+QoS 1 inflight frames are not persisted: they live in each connection's
+inflight window and are retransmitted by the peer's normal QoS 1 flow on
+reconnect, so writing every in-flight payload to disk would cost far more
+than it saves.
+
+Record format, one per line, tab-separated:
+    S\t<client_id>\t<filter>    subscription added
+    C\t<client_id>              client state cleared (Clean Session)
+A torn final line from a crash mid-append is skipped on replay.
+*/
+
+use std::collections::{HashMap, HashSet};
+use std::fs::{self, File, OpenOptions};
+use std::io::{BufRead, BufReader, BufWriter, Write};
+use std::sync::mpsc::{self, Receiver, Sender};
+use std::sync::{Arc, Mutex, OnceLock};
+use std::thread;
+
+use crate::{log_error, log_info};
+
+/// Default log path, in the broker's working directory.
+const LOG_PATH: &str = "sessions.log";
+
+/// Appended records between compactions; keeps the log from growing
+/// unboundedly under subscription churn.
+const RECORDS_PER_COMPACTION: u64 = 10_000;
+
+/// One persistence event, sent from the packet paths to the writer thread.
+enum Record {
+    Subscribe { client_id: String, filter: String },
+    Clear { client_id: String },
+}
+
+/// Live mirror of the persisted state: client ID to subscription filters.
+/// The packet paths update it in O(1); the writer reads it to compact.
+type Mirror = Arc<Mutex<HashMap<String, HashSet<String>>>>;
+
+/// Handle to the persistence layer; all methods are cheap and disk-free.
+pub struct SessionStore {
+    tx: Sender<Record>,
+    mirror: Mirror,
+}
+
+impl SessionStore {
+    /// Replays the log into memory and spawns the writer thread.
+    fn open(path: &str) -> Self {
+        let restored = replay(path);
+        if !restored.is_empty() {
+            let filters: usize = restored.values().map(|set| set.len()).sum();
+            log_info!(
+                "[+]Restored {} sessions ({} subscriptions) from {}\n",
+                restored.len(),
+                filters,
+                path
+            );
+        }
+
+        let mirror: Mirror = Arc::new(Mutex::new(restored));
+        let (tx, rx) = mpsc::channel();
+
+        let writer_mirror = Arc::clone(&mirror);
+        let writer_path = path.to_string();
+        thread::spawn(move || {
+            run_writer(&writer_path, rx, writer_mirror);
+        });
+
+        SessionStore { tx, mirror }
+    }
+
+    /// Records a subscription; mirror update plus one channel send.
+    pub fn record_subscribe(&self, client_id: &str, filter: &str) {
+        let inserted = self
+            .mirror
+            .lock()
+            .unwrap()
+            .entry(client_id.to_string())
+            .or_insert_with(HashSet::new)
+            .insert(filter.to_string());
+        // Duplicate SUBSCRIBEs are common (clients re-subscribe on every
+        // reconnect); only genuinely new filters reach the log
+        if inserted {
+            let _ = self.tx.send(Record::Subscribe {
+                client_id: client_id.to_string(),
+                filter: filter.to_string(),
+            });
+        }
+    }
+
+    /// Wipes a client's stored state (CONNECT with Clean Session).
+    pub fn clear(&self, client_id: &str) {
+        let existed = self.mirror.lock().unwrap().remove(client_id).is_some();
+        if existed {
+            let _ = self.tx.send(Record::Clear {
+                client_id: client_id.to_string(),
+            });
+        }
+    }
+
+    /// The filters a client held when it was last connected; empty for a
+    /// client the store has never seen.
+    pub fn saved_filters(&self, client_id: &str) -> Vec<String> {
+        self.mirror
+            .lock()
+            .unwrap()
+            .get(client_id)
+            .map(|set| set.iter().cloned().collect())
+            .unwrap_or_default()
+    }
+}
+
+/// The process-wide session store, opened on first use.
+pub fn store() -> &'static SessionStore {
+    static STORE: OnceLock<SessionStore> = OnceLock::new();
+    STORE.get_or_init(|| SessionStore::open(LOG_PATH))
+}
+
+/// Reads the whole log once at startup, newest record winning. A buffered
+/// sequential read keeps replay I/O-bound; a malformed (torn) line is
+/// skipped rather than aborting the restore.
+fn replay(path: &str) -> HashMap<String, HashSet<String>> {
+    let mut state: HashMap<String, HashSet<String>> = HashMap::new();
+
+    let file = match File::open(path) {
+        Ok(file) => file,
+        Err(_) => return state, // First start: no log yet
+    };
+
+    for line in BufReader::new(file).lines() {
+        let line = match line {
+            Ok(line) => line,
+            Err(_) => break,
+        };
+        let mut fields = line.split('\t');
+        match (fields.next(), fields.next(), fields.next()) {
+            (Some("S"), Some(client_id), Some(filter)) => {
+                state
+                    .entry(client_id.to_string())
+                    .or_insert_with(HashSet::new)
+                    .insert(filter.to_string());
+            }
+            (Some("C"), Some(client_id), None) => {
+                state.remove(client_id);
+            }
+            _ => {} // Torn or unknown line: skip
+        }
+    }
+
+    state
+}
+
+/// Body of the writer thread: appends records as they arrive and compacts
+/// the log once enough of them accumulate.
+fn run_writer(path: &str, rx: Receiver<Record>, mirror: Mirror) {
+    let mut writer = match open_appender(path) {
+        Some(writer) => writer,
+        None => return,
+    };
+    let mut appended: u64 = 0;
+
+    while let Ok(record) = rx.recv() {
+        // Drain whatever else is queued so a burst becomes one flush
+        let mut batch = vec![record];
+        while let Ok(record) = rx.try_recv() {
+            batch.push(record);
+        }
+
+        for record in batch {
+            let line = match record {
+                Record::Subscribe { client_id, filter } => {
+                    format!("S\t{}\t{}\n", client_id, filter)
+                }
+                Record::Clear { client_id } => format!("C\t{}\n", client_id),
+            };
+            if writer.write_all(line.as_bytes()).is_err() {
+                log_error!("[-]Error appending to session log\n");
+            }
+            appended += 1;
+        }
+        let _ = writer.flush();
+
+        if appended >= RECORDS_PER_COMPACTION {
+            if compact(path, &mirror) {
+                appended = 0;
+                writer = match open_appender(path) {
+                    Some(writer) => writer,
+                    None => return,
+                };
+            }
+        }
+    }
+}
+
+/// Opens the log for appending, creating it on first use.
+fn open_appender(path: &str) -> Option<BufWriter<File>> {
+    match OpenOptions::new().create(true).append(true).open(path) {
+        Ok(file) => Some(BufWriter::new(file)),
+        Err(e) => {
+            log_error!("[-]Error opening session log {}: {}\n", path, e);
+            None
+        }
+    }
+}
+
+/// Rewrites the log from the live mirror and renames it into place, so a
+/// crash mid-compaction leaves the old log intact.
+fn compact(path: &str, mirror: &Mirror) -> bool {
+    let tmp_path = format!("{}.tmp", path);
+    let file = match File::create(&tmp_path) {
+        Ok(file) => file,
+        Err(e) => {
+            log_error!("[-]Error creating {}: {}\n", tmp_path, e);
+            return false;
+        }
+    };
+    let mut writer = BufWriter::new(file);
+
+    {
+        let state = mirror.lock().unwrap();
+        for (client_id, filters) in state.iter() {
+            for filter in filters.iter() {
+                if writer
+                    .write_all(format!("S\t{}\t{}\n", client_id, filter).as_bytes())
+                    .is_err()
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    if writer.flush().is_err() {
+        return false;
+    }
+    match fs::rename(&tmp_path, path) {
+        Ok(_) => {
+            log_info!("[+]Compacted session log {}\n", path);
+            true
+        }
+        Err(e) => {
+            log_error!("[-]Error swapping in compacted session log: {}\n", e);
+            false
+        }
+    }
+}
@@ -0,0 +1,87 @@
+/// Retained-message store with copy-on-write snapshots.
+
+/*
+The PUBLISH retain flag was parsed but ignored, so a reconnecting subscriber
+(e.g. a dashboard) had to wait a full sensor period before seeing a value.
+
+The store keeps the latest retained PUBLISH frame per topic. The map lives
+behind an Arc that writers replace wholesale (clone, mutate, swap), so the
+read side taken on SUBSCRIBE is a cheap Arc clone of an immutable snapshot:
+delivering retained state to a new subscriber never blocks concurrent
+publishers, and publishers never wait for a slow subscriber walk.
+*/
+
+use std::collections::HashMap;
+use std::sync::{Arc, OnceLock, RwLock};
+
+use bytes::Bytes;
+
+use crate::log_error;
+
+/// Default per-topic cap on the retained frame size. One retained frame is
+/// kept per topic forever, so without a cap a single oversized publish per
+/// topic grows the store without bound.
+const DEFAULT_MAX_RETAINED_BYTES: usize = 256 * 1024;
+
+/// The per-topic retained-frame byte budget, overridable through the
+/// MQTT_MAX_RETAINED_BYTES environment variable (read once at first use).
+fn max_retained_bytes() -> usize {
+    static BUDGET: OnceLock<usize> = OnceLock::new();
+    *BUDGET.get_or_init(|| {
+        std::env::var("MQTT_MAX_RETAINED_BYTES")
+            .ok()
+            .and_then(|value| value.parse().ok())
+            .unwrap_or(DEFAULT_MAX_RETAINED_BYTES)
+    })
+}
+
+/// Latest retained PUBLISH frame per topic, stored as the raw wire bytes the
+/// broker forwards unmodified.
+pub struct RetainedStore {
+    snapshot: RwLock<Arc<HashMap<String, Bytes>>>,
+}
+
+impl RetainedStore {
+    /// Creates an empty store.
+    pub fn new() -> Self {
+        RetainedStore {
+            snapshot: RwLock::new(Arc::new(HashMap::new())),
+        }
+    }
+
+    /// Records the frame as the retained message for a topic, replacing any
+    /// previous one. Copy-on-write: readers keep their old snapshot. Frames
+    /// over the per-topic byte budget are refused, checked right here on the
+    /// way in so the store's memory stays bounded without any sweep.
+    pub fn store(&self, topic: &str, frame: Bytes) {
+        if frame.len() > max_retained_bytes() {
+            log_error!(
+                "[-]Retained message for topic {} over the {}-byte budget; not stored\n",
+                topic,
+                max_retained_bytes()
+            );
+            return;
+        }
+        let mut guard = self.snapshot.write().unwrap();
+        let mut updated = (**guard).clone();
+        updated.insert(topic.to_string(), frame);
+        *guard = Arc::new(updated);
+    }
+
+    /// Removes the retained message for a topic (an empty retained payload
+    /// clears the topic, per MQTT).
+    pub fn clear(&self, topic: &str) {
+        let mut guard = self.snapshot.write().unwrap();
+        if guard.contains_key(topic) {
+            let mut updated = (**guard).clone();
+            updated.remove(topic);
+            *guard = Arc::new(updated);
+        }
+    }
+
+    /// Takes an immutable snapshot of the whole store; the caller can walk it
+    /// without holding any lock.
+    pub fn snapshot(&self) -> Arc<HashMap<String, Bytes>> {
+        Arc::clone(&self.snapshot.read().unwrap())
+    }
+}
@@ -0,0 +1,125 @@
+/// Session registry keyed by MQTT client ID.
+
+/*
+Client cleanup used to scan a global Vec<TcpStream> and call peer_addr() (a
+syscall) on every element under one mutex, so a disconnect storm cost O(n^2)
+syscalls. Sessions are now registered under the client ID parsed from the
+CONNECT packet, giving O(1) insert and remove, and the Session struct is the
+home for per-session state: the outbound queue (which owns the QoS 1 inflight
+window), the negotiated keep-alive, and the list of subscribed filters.
+*/
+
+use std::collections::HashMap;
+use std::sync::{Arc, Mutex};
+use std::time::{Duration, Instant};
+
+use crate::outbound::Outbound;
+use crate::subscriptions::SubscriptionTable;
+
+/// Per-client state, created when a CONNECT packet is accepted.
+pub struct Session {
+    pub client_id: String,           // Identifier from the CONNECT packet
+    pub outbound: Outbound,          // Write queue (owns the inflight window)
+    pub keep_alive: u16,             // Keep-alive interval, in seconds
+    pub subscriptions: Mutex<Vec<String>>, // Topic filters this session holds
+    last_activity: Mutex<Instant>,   // Refreshed by every inbound packet
+}
+
+impl Session {
+    /// Creates a session from the fields negotiated during CONNECT.
+    pub fn new(client_id: String, outbound: Outbound, keep_alive: u16) -> Self {
+        Session {
+            client_id,
+            outbound,
+            keep_alive,
+            subscriptions: Mutex::new(Vec::new()),
+            last_activity: Mutex::new(Instant::now()),
+        }
+    }
+
+    /// Marks the session as alive; called for every inbound packet so the
+    /// timer wheel can tell an idle client from a dead one.
+    pub fn touch(&self) {
+        *self.last_activity.lock().unwrap() = Instant::now();
+    }
+
+    /// How long this session has been silent.
+    pub fn idle_for(&self) -> Duration {
+        self.last_activity.lock().unwrap().elapsed()
+    }
+
+    /// Records a filter this session subscribed to, so disconnect can
+    /// unlink it from the topic lists without scanning everything. A filter
+    /// already recorded (a restored subscription the client re-sends) is
+    /// kept once.
+    pub fn add_subscription(&self, filter: &str) {
+        let mut filters = self.subscriptions.lock().unwrap();
+        if !filters.iter().any(|f| f == filter) {
+            filters.push(filter.to_string());
+        }
+    }
+
+    /// Unlinks this session from every topic list it subscribed to, using
+    /// the recorded filters as back-pointers: cleanup cost is proportional to
+    /// the session's own subscriptions, not to the size of the table.
+    pub fn unsubscribe_all(&self, table: &SubscriptionTable) {
+        let mut filters = self.subscriptions.lock().unwrap();
+        for filter in filters.drain(..) {
+            table.unsubscribe(&filter, self.outbound.id());
+        }
+    }
+}
+
+/// Registry of live sessions, keyed by client ID.
+pub struct SessionRegistry {
+    sessions: Mutex<HashMap<String, Arc<Session>>>,
+}
+
+impl SessionRegistry {
+    /// Creates an empty registry.
+    pub fn new() -> Self {
+        SessionRegistry {
+            sessions: Mutex::new(HashMap::new()),
+        }
+    }
+
+    /// Registers a session under its client ID in O(1). Returns the previous
+    /// session with the same ID, if any (MQTT session takeover).
+    pub fn insert(&self, session: Arc<Session>) -> Option<Arc<Session>> {
+        self.sessions
+            .lock()
+            .unwrap()
+            .insert(session.client_id.clone(), session)
+    }
+
+    /// Removes and returns the session for a client ID in O(1).
+    pub fn remove(&self, client_id: &str) -> Option<Arc<Session>> {
+        self.sessions.lock().unwrap().remove(client_id)
+    }
+
+    /// Removes the entry for this session's client ID only when the registry
+    /// still holds this very session. A connection cleaning up after being
+    /// taken over shares its client ID with its replacement, so removal
+    /// keyed on the ID alone would unregister the live session and leave two
+    /// connections claiming the same ID. Returns true when removed.
+    pub fn remove_if_current(&self, session: &Arc<Session>) -> bool {
+        let mut sessions = self.sessions.lock().unwrap();
+        match sessions.get(&session.client_id) {
+            Some(current) if Arc::ptr_eq(current, session) => {
+                sessions.remove(&session.client_id);
+                true
+            }
+            _ => false,
+        }
+    }
+
+    /// Looks up a live session by client ID.
+    pub fn get(&self, client_id: &str) -> Option<Arc<Session>> {
+        self.sessions.lock().unwrap().get(client_id).cloned()
+    }
+
+    /// Number of live sessions.
+    pub fn len(&self) -> usize {
+        self.sessions.lock().unwrap().len()
+    }
+}
@@ -0,0 +1,365 @@
+/// Sharded topic-trie subscription table for the MQTT broker.
+
+/*
+The broker used to keep every subscription behind one global
+Arc<Mutex<HashMap<String, Vec<TcpStream>>>>, so every PUBLISH fan-out and every
+SUBSCRIBE serialized on a single lock even when they touched unrelated topics,
+and only exact topic matches were possible.
+
+This table splits the subscriptions into a fixed number of shards selected by
+the first topic level, and each shard holds a trie keyed on '/'-separated
+levels. Subscription filters may contain the MQTT wildcards '+' (one level)
+and '#' (all remaining levels); a publish resolves every matching subscriber
+set in a single walk proportional to the topic depth, not to the number of
+subscribers. Publishes to different topics land on different shards and never
+contend, and the hot read path only takes a shared read lock on its shard.
+
+Filters of the form $share/<group>/<filter> are MQTT 5 shared subscriptions:
+all members of a group collectively receive each matching message exactly
+once, dealt out round-robin, so a pool of workers splits the stream instead
+of every worker receiving (and discarding) all of it. Group members live in
+the trie next to ordinary subscribers, keyed by group name, and the
+round-robin cursor is an atomic so dispatch stays on the shared read lock.
+*/
+
+use std::collections::hash_map::DefaultHasher;
+use std::collections::HashMap;
+use std::hash::{Hash, Hasher};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::RwLock;
+
+use crate::outbound::Outbound;
+
+/// Number of independent shards; a small power of two is plenty to spread
+/// unrelated topics apart without wasting memory.
+const SHARD_COUNT: usize = 16;
+
+/// Members of one shared-subscription group whose filter ends at a node;
+/// each matching message goes to exactly one member.
+struct SharedGroup {
+    members: Vec<Outbound>,
+    next: AtomicUsize, // Round-robin cursor; atomic so reads never lock
+}
+
+impl SharedGroup {
+    fn new() -> Self {
+        SharedGroup {
+            members: Vec::new(),
+            next: AtomicUsize::new(0),
+        }
+    }
+
+    /// Delivers to the next live member, round-robin; dead members are
+    /// skipped so a crashed worker never swallows its share of the stream.
+    fn visit_one<F>(&self, f: &mut F) -> bool
+    where
+        F: FnMut(&Outbound),
+    {
+        if self.members.is_empty() {
+            return false;
+        }
+        let start = self.next.fetch_add(1, Ordering::Relaxed);
+        for offset in 0..self.members.len() {
+            let member = &self.members[(start + offset) % self.members.len()];
+            if !member.is_dead() {
+                f(member);
+                return true;
+            }
+        }
+        false
+    }
+}
+
+/// One node of the topic trie; children are keyed by topic level, with the
+/// wildcard levels '+' and '#' stored as ordinary child keys.
+struct TrieNode {
+    children: HashMap<String, TrieNode>,
+    subscribers: Vec<Outbound>, // Clients whose filter ends at this node
+    shared_groups: HashMap<String, SharedGroup>, // Shared subscriptions ending here
+}
+
+impl TrieNode {
+    fn new() -> Self {
+        TrieNode {
+            children: HashMap::new(),
+            subscribers: Vec::new(),
+            shared_groups: HashMap::new(),
+        }
+    }
+
+    /// Whether this node holds no subscribers, groups or children at all.
+    fn is_empty(&self) -> bool {
+        self.subscribers.is_empty() && self.children.is_empty() && self.shared_groups.is_empty()
+    }
+
+    /// Removes a subscriber (by connection ID) under the remaining filter
+    /// levels, pruning child nodes left empty. Returns true when this node
+    /// itself holds nothing anymore.
+    fn remove(&mut self, levels: &[&str], id: u64) -> bool {
+        match levels.split_first() {
+            None => {
+                self.subscribers.retain(|s| s.id() != id);
+                for group in self.shared_groups.values_mut() {
+                    group.members.retain(|s| s.id() != id);
+                }
+                self.shared_groups.retain(|_, group| !group.members.is_empty());
+            }
+            Some((level, rest)) => {
+                let child_empty = self
+                    .children
+                    .get_mut(*level)
+                    .map_or(false, |child| child.remove(rest, id));
+                if child_empty {
+                    self.children.remove(*level);
+                }
+            }
+        }
+        self.is_empty()
+    }
+
+    /// Drops every subscriber whose connection is dead and prunes emptied
+    /// child nodes. Returns true when this node itself holds nothing anymore.
+    fn retain_alive(&mut self) -> bool {
+        self.subscribers.retain(|s| !s.is_dead());
+        for group in self.shared_groups.values_mut() {
+            group.members.retain(|s| !s.is_dead());
+        }
+        self.shared_groups.retain(|_, group| !group.members.is_empty());
+        self.children.retain(|_, child| !child.retain_alive());
+        self.is_empty()
+    }
+
+    /// Inserts a subscriber under the remaining filter levels. Per MQTT a
+    /// re-subscription replaces the existing one rather than adding a second
+    /// entry, so a connection already in the list (e.g. a restored filter
+    /// the client then re-SUBSCRIBEs on reconnect) is not duplicated —
+    /// otherwise it would receive every matching message twice.
+    fn insert(&mut self, levels: &[&str], outbound: Outbound) {
+        match levels.split_first() {
+            None => {
+                if !self.subscribers.iter().any(|s| s.id() == outbound.id()) {
+                    self.subscribers.push(outbound);
+                }
+            }
+            Some((level, rest)) => {
+                self.children
+                    .entry(level.to_string())
+                    .or_insert_with(TrieNode::new)
+                    .insert(rest, outbound);
+            }
+        }
+    }
+
+    /// Inserts a shared-group member under the remaining filter levels; like
+    /// insert(), a connection already in the group is not added again.
+    fn insert_shared(&mut self, levels: &[&str], group: &str, outbound: Outbound) {
+        match levels.split_first() {
+            None => {
+                let members = &mut self
+                    .shared_groups
+                    .entry(group.to_string())
+                    .or_insert_with(SharedGroup::new)
+                    .members;
+                if !members.iter().any(|s| s.id() == outbound.id()) {
+                    members.push(outbound);
+                }
+            }
+            Some((level, rest)) => {
+                self.children
+                    .entry(level.to_string())
+                    .or_insert_with(TrieNode::new)
+                    .insert_shared(rest, group, outbound);
+            }
+        }
+    }
+
+    /// Visits every subscriber whose filter ends at this node: all ordinary
+    /// subscribers, plus exactly one member of each shared group.
+    fn visit_node<F>(&self, f: &mut F) -> bool
+    where
+        F: FnMut(&Outbound),
+    {
+        let mut matched = false;
+        for subscriber in self.subscribers.iter() {
+            f(subscriber);
+            matched = true;
+        }
+        for group in self.shared_groups.values() {
+            matched |= group.visit_one(f);
+        }
+        matched
+    }
+
+    /// Walks the trie against the topic levels, visiting every subscriber
+    /// whose filter matches. Returns true when at least one matched.
+    fn visit_matches<F>(&self, levels: &[&str], f: &mut F) -> bool
+    where
+        F: FnMut(&Outbound),
+    {
+        let mut matched = false;
+
+        // A '#' child matches the remaining levels, including none at all
+        // (per MQTT, "sport/#" also matches "sport" itself)
+        if let Some(multi) = self.children.get("#") {
+            matched |= multi.visit_node(f);
+        }
+
+        match levels.split_first() {
+            None => {
+                // Topic fully consumed: subscribers at this node match exactly
+                matched |= self.visit_node(f);
+            }
+            Some((level, rest)) => {
+                // Exact level match
+                if let Some(child) = self.children.get(*level) {
+                    matched |= child.visit_matches(rest, f);
+                }
+                // '+' matches exactly one level, whatever it is
+                if let Some(child) = self.children.get("+") {
+                    matched |= child.visit_matches(rest, f);
+                }
+            }
+        }
+
+        matched
+    }
+}
+
+/// Splits a shared-subscription filter "$share/<group>/<filter>" into its
+/// group name and underlying topic filter; None for ordinary filters.
+pub fn parse_shared_filter(filter: &str) -> Option<(&str, &str)> {
+    let rest = filter.strip_prefix("$share/")?;
+    let slash = rest.find('/')?;
+    let group = &rest[..slash];
+    let topic_filter = &rest[slash + 1..];
+    if group.is_empty() || topic_filter.is_empty() {
+        return None;
+    }
+    Some((group, topic_filter))
+}
+
+/// Checks whether a subscription filter (which may contain '+' and '#')
+/// matches a concrete topic name, level by level. A shared filter matches
+/// whatever its underlying topic filter matches.
+pub fn filter_matches(filter: &str, topic: &str) -> bool {
+    let filter = match parse_shared_filter(filter) {
+        Some((_, topic_filter)) => topic_filter,
+        None => filter,
+    };
+    let mut filter_levels = filter.split('/');
+    let mut topic_levels = topic.split('/');
+
+    loop {
+        match (filter_levels.next(), topic_levels.next()) {
+            // '#' swallows the rest of the topic, including nothing at all
+            (Some("#"), _) => return true,
+            // '+' matches exactly one level of any name
+            (Some("+"), Some(_)) => continue,
+            (Some(f), Some(t)) if f == t => continue,
+            // Both exhausted at the same time: exact match
+            (None, None) => return true,
+            _ => return false,
+        }
+    }
+}
+
+/// Subscription table sharded by first topic level, one trie per shard behind
+/// a read-write lock.
+pub struct SubscriptionTable {
+    shards: Vec<RwLock<TrieNode>>,
+}
+
+impl SubscriptionTable {
+    /// Creates an empty table with all shards initialized.
+    pub fn new() -> Self {
+        let mut shards = Vec::with_capacity(SHARD_COUNT);
+        for _ in 0..SHARD_COUNT {
+            shards.push(RwLock::new(TrieNode::new()));
+        }
+        SubscriptionTable { shards }
+    }
+
+    /// Selects the shard index for a topic by hashing its first level.
+    fn shard_index(first_level: &str) -> usize {
+        let mut hasher = DefaultHasher::new();
+        first_level.hash(&mut hasher);
+        (hasher.finish() as usize) % SHARD_COUNT
+    }
+
+    /// Adds a subscriber's outbound queue under a topic filter, which may
+    /// contain the '+' and '#' wildcards as whole levels.
+    pub fn subscribe(&self, filter: &str, outbound: Outbound) {
+        // A $share/<group>/<filter> subscription joins the group under the
+        // underlying filter instead of subscribing individually
+        if let Some((group, topic_filter)) = parse_shared_filter(filter) {
+            let levels: Vec<&str> = topic_filter.split('/').collect();
+            if levels[0] == "+" || levels[0] == "#" {
+                for shard in self.shards.iter() {
+                    shard
+                        .write()
+                        .unwrap()
+                        .insert_shared(&levels, group, outbound.clone());
+                }
+            } else {
+                let shard = &self.shards[Self::shard_index(levels[0])];
+                shard.write().unwrap().insert_shared(&levels, group, outbound);
+            }
+            return;
+        }
+
+        let levels: Vec<&str> = filter.split('/').collect();
+
+        // A filter starting with a wildcard can match topics in any shard,
+        // so it has to be inserted into all of them
+        if levels[0] == "+" || levels[0] == "#" {
+            for shard in self.shards.iter() {
+                shard.write().unwrap().insert(&levels, outbound.clone());
+            }
+        } else {
+            let shard = &self.shards[Self::shard_index(levels[0])];
+            shard.write().unwrap().insert(&levels, outbound);
+        }
+    }
+
+    /// Unlinks one connection from a topic filter, touching only the shards
+    /// the matching subscribe() inserted into.
+    pub fn unsubscribe(&self, filter: &str, connection_id: u64) {
+        // Shared filters were inserted under their underlying topic filter;
+        // remove() clears the connection from groups and plain lists alike
+        let filter = match parse_shared_filter(filter) {
+            Some((_, topic_filter)) => topic_filter,
+            None => filter,
+        };
+        let levels: Vec<&str> = filter.split('/').collect();
+
+        if levels[0] == "+" || levels[0] == "#" {
+            for shard in self.shards.iter() {
+                shard.write().unwrap().remove(&levels, connection_id);
+            }
+        } else {
+            let shard = &self.shards[Self::shard_index(levels[0])];
+            shard.write().unwrap().remove(&levels, connection_id);
+        }
+    }
+
+    /// Sweeps dead subscribers out of the shard owning a topic. Called lazily
+    /// from the fan-out path after a delivery to a dead connection, so topic
+    /// lists cannot accumulate stale entries between disconnect cleanups.
+    pub fn evict_dead(&self, topic: &str) {
+        let first_level = topic.split('/').next().unwrap_or("");
+        let shard = &self.shards[Self::shard_index(first_level)];
+        shard.write().unwrap().retain_alive();
+    }
+
+    /// Runs the closure over every subscriber whose filter matches the topic,
+    /// under a shared read lock on the topic's shard, so concurrent publishes
+    /// are never blocked. Returns false when nothing matched.
+    pub fn for_each_subscriber<F>(&self, topic: &str, mut f: F) -> bool
+    where
+        F: FnMut(&Outbound),
+    {
+        let levels: Vec<&str> = topic.split('/').collect();
+        let shard = self.shards[Self::shard_index(levels[0])].read().unwrap();
+        shard.visit_matches(&levels, &mut f)
+    }
+}
@@ -0,0 +1,147 @@
+/// Hashed timer wheel enforcing keep-alive deadlines for every session.
+
+/*
+Keep-alive used to be checked inline on each connection's own thread, and only
+after a successful blocking read, so a client that went silent was never
+detected; the epoll workers instead rescanned every connection once per second.
+Neither approach scales, and the client side busy-polled its shutdown flag.
+
+The wheel is a fixed ring of slots, one per one-second tick. A session is
+hashed into the slot of its deadline tick, so a single housekeeping thread does
+O(1) work per tick plus one check per session actually due, no matter how many
+thousands of idle connections exist. Any inbound packet refreshes the session's
+activity timestamp; when an entry comes due, the session is either expired (a
+DISCONNECT is enqueued and its socket shut down, which unblocks the reader) or
+pushed one lap forward from its last activity.
+*/
+
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex, Weak};
+use std::thread;
+use std::time::Duration;
+
+use bytes::Bytes;
+
+use crate::log_info;
+use crate::packets::disconnect::{DisconnectPacket, DisconnectReasonCode};
+use crate::session::Session;
+
+/// Number of slots in the ring; deadlines further out simply wrap around and
+/// are re-checked on a later lap.
+const WHEEL_SLOTS: usize = 512;
+
+/// Granularity of the wheel: one slot per second.
+const TICK_INTERVAL: Duration = Duration::from_secs(1);
+
+/// One scheduled deadline. The session is held weakly so a closed connection
+/// just evaporates from the wheel instead of needing explicit cancellation.
+struct Entry {
+    session: Weak<Session>,
+    deadline_tick: u64,
+}
+
+/// Hashed timer wheel owned by a single housekeeping thread.
+pub struct TimerWheel {
+    slots: Vec<Mutex<Vec<Entry>>>,
+    current_tick: AtomicU64,
+}
+
+impl TimerWheel {
+    /// Creates the wheel and spawns the housekeeping thread that drives it.
+    pub fn start() -> Arc<TimerWheel> {
+        let mut slots = Vec::with_capacity(WHEEL_SLOTS);
+        for _ in 0..WHEEL_SLOTS {
+            slots.push(Mutex::new(Vec::new()));
+        }
+
+        let wheel = Arc::new(TimerWheel {
+            slots,
+            current_tick: AtomicU64::new(0),
+        });
+
+        let ticker = Arc::clone(&wheel);
+        thread::spawn(move || loop {
+            thread::sleep(TICK_INTERVAL);
+            ticker.advance();
+        });
+
+        wheel
+    }
+
+    /// Grace period in seconds for a keep-alive value: the MQTT spec allows
+    /// one and a half keep-alive intervals of silence before disconnecting.
+    fn grace(keep_alive: u16) -> u64 {
+        (keep_alive as u64 * 3 / 2).max(1)
+    }
+
+    /// Starts tracking a session's keep-alive deadline. A keep-alive of zero
+    /// disables the mechanism entirely, per MQTT.
+    pub fn schedule(&self, session: &Arc<Session>) {
+        if session.keep_alive == 0 {
+            return;
+        }
+        self.insert(Arc::downgrade(session), Self::grace(session.keep_alive));
+    }
+
+    /// Hashes an entry into the slot of its deadline tick.
+    fn insert(&self, session: Weak<Session>, delay_ticks: u64) {
+        let deadline_tick =
+            self.current_tick.load(Ordering::Relaxed) + delay_ticks.max(1);
+        let slot = deadline_tick as usize % WHEEL_SLOTS;
+        self.slots[slot].lock().unwrap().push(Entry {
+            session,
+            deadline_tick,
+        });
+    }
+
+    /// One tick of the wheel: drains the current slot and decides, for each
+    /// entry actually due, whether its session expired or gets rescheduled.
+    fn advance(&self) {
+        let tick = self.current_tick.fetch_add(1, Ordering::Relaxed) + 1;
+        let slot = tick as usize % WHEEL_SLOTS;
+
+        // Entries whose deadline is a later lap of the ring stay in the slot
+        let due: Vec<Entry> = {
+            let mut entries = self.slots[slot].lock().unwrap();
+            let mut kept = Vec::new();
+            let mut due = Vec::new();
+            for entry in entries.drain(..) {
+                if entry.deadline_tick > tick {
+                    kept.push(entry);
+                } else {
+                    due.push(entry);
+                }
+            }
+            *entries = kept;
+            due
+        };
+
+        for entry in due {
+            // A dropped session means the connection already closed
+            let session = match entry.session.upgrade() {
+                Some(session) => session,
+                None => continue,
+            };
+
+            let grace = Self::grace(session.keep_alive);
+            let idle = session.idle_for().as_secs();
+
+            if idle >= grace {
+                // Silent past the grace period: tell the client why and shut
+                // the socket down, which also unblocks its reader
+                let mut disconnect_packet =
+                    DisconnectPacket::new(DisconnectReasonCode::KeepAliveTimeout);
+                disconnect_packet.add_property(0x11, vec![0x01, 0x02]);
+                session.outbound.send(Bytes::from(disconnect_packet.encode()));
+                session.outbound.shutdown();
+                log_info!(
+                    "[-]Keep-alive expired for client: {}. Closing connection.\n",
+                    session.client_id
+                );
+            } else {
+                // Recent activity: push the deadline forward from it
+                self.insert(entry.session, grace - idle);
+            }
+        }
+    }
+}